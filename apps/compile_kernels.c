@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <CL/cl.h>
+#include "cl_error_handlers.h"
+#include "cl_boilerplate.h"
+#include "clbp_error_handling.h"
+#include "clbp_parse_manifest.h"
+#include "clbp_kernel_bundle.h"
+
+#define KERNEL_DIR "kernel/"
+#define KERNEL_SRC_DIR	KERNEL_DIR"kern_src/"
+#define KERNEL_INC_DIR	KERNEL_DIR"inc/"
+#define BUNDLE_FNAME	KERNEL_DIR"kernels.clbundle"
+// same as plugboard's release build args, bundles are only meant for release runs since arg info isn't kept
+#define KERNEL_RELEASE_BUILD_ARGS "-I"KERNEL_INC_DIR" -Werror -cl-single-precision-constant -cl-fast-relaxed-math"
+
+// offline compiler for plugboard's release mode, builds every kernel program MANIFEST.toml uses and saves them as a bundle
+// that can be loaded without compiling, see clbp_kernel_bundle.h
+// usage: compile_kernels [bundle path] [device=<index>] [profile=<name>]
+// the device index counts every device of the first platform, the bundle only loads on the device it was built for
+
+static cl_device_id getDeviceByIndex(cl_uint idx)
+{
+	cl_platform_id platform;
+	cl_int clErr = clGetPlatformIDs(1, &platform, NULL);
+	handleClError(clErr, "clGetPlatformIDs");
+
+	cl_uint device_cnt;
+	clErr = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 0, NULL, &device_cnt);
+	handleClError(clErr, "clGetDeviceIDs");
+	if(idx >= device_cnt)
+	{
+		fprintf(stderr, "\nERROR: device %u requested but the first platform only has %u.\n", idx, device_cnt);
+		exit(1);
+	}
+
+	cl_device_id* devices = malloc(device_cnt * sizeof(cl_device_id));
+	if(!devices)
+		handleClBoilerplateError((clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "device list"});
+	clErr = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, device_cnt, devices, NULL);
+	handleClError(clErr, "clGetDeviceIDs");
+	cl_device_id device = devices[idx];
+	free(devices);
+	return device;
+}
+
+// every stage's kernel has to be in the program or instantiateKernels() fails at runtime instead of here
+static void checkKernelsPresent(cl_program prog, QStaging const* staging)
+{
+	for(int i = 0; i < staging->kernel_cnt; ++i)
+	{
+		cl_int clErr;
+		cl_kernel kernel = clCreateKernel(prog, staging->kprog_names[i], &clErr);
+		if(clErr)
+			fprintf(stderr, "@ kernel %s: ", staging->kprog_names[i]);
+		handleClError(clErr, "clCreateKernel");
+		clReleaseKernel(kernel);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	char const* bundle_fname = BUNDLE_FNAME;
+	char const* profile = NULL;
+	cl_uint device_idx = 0;
+	for(int i = 1; i < argc; ++i)
+	{
+		if(sscanf(argv[i], "device=%u", &device_idx) == 1)
+			continue;
+		else if(!strncmp(argv[i], "profile=", 8))
+			profile = argv[i] + 8;
+		else
+			bundle_fname = argv[i];
+	}
+
+	cl_device_id device = getDeviceByIndex(device_idx);
+	char device_name[128] = {0};
+	clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+	printf("Building kernel bundle for %s\n", device_name);
+
+	cl_int clErr;
+	cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &clErr);
+	handleClError(clErr, "clCreateContext");
+
+	clbp_Error e = {.err_code = CLBP_OK};
+	toml_table_t* root_tbl = parseManifestFile("MANIFEST.toml", &e);
+	handleClBoilerplateError(e);
+	QStaging staging = {.input_img_cnt = 1};
+	allocQStagingArrays(root_tbl, &staging, &e);
+	handleClBoilerplateError(e);
+	// has to match the profile the bundle is run with or its kernel list won't match
+	selectStageProfile(root_tbl, profile, KERNEL_SRC_DIR, &staging, &e);
+	handleClBoilerplateError(e);
+	populateQStagingArrays(root_tbl, &staging, &e);
+	handleClBoilerplateError(e);
+
+	cl_program prog = buildKernelProgsFromSource(context, device, KERNEL_SRC_DIR, &staging, KERNEL_RELEASE_BUILD_ARGS, &e);
+	handleClBoilerplateError(e);
+	checkKernelsPresent(prog, &staging);
+	saveKernelBundle(prog, device, &staging, KERNEL_SRC_DIR, KERNEL_RELEASE_BUILD_ARGS, bundle_fname, &e);
+	clReleaseProgram(prog);
+	handleClBoilerplateError(e);
+	printf("Saved %i kernel programs to %s\n", staging.kernel_cnt, bundle_fname);
+
+	freeQStagingArrays(&staging);
+	toml_free(root_tbl);
+	clReleaseContext(context);
+	return 0;
+}
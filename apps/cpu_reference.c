@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "cpu_pipeline.h"
+#include "thread_pool.h"
+#define STBI_DECLARATIONS_ONLY
+#include "stb_image.h"
+#define STBIW_DECLARATIONS_ONLY
+#include "stb_image_write.h"
+
+// runs the production chain on the CPU and reports per stage timings for comparison with the OpenCL pipeline
+// usage: cpu_reference [input image] [thread count, 0 for all hardware threads] [iterations]
+int main(int argc, char* argv[])
+{
+	char const* fname = argc > 1 ? argv[1] : "images/input.png";
+	int thread_cnt = argc > 2 ? atoi(argv[2]) : 0;
+	int iterations = argc > 3 ? atoi(argv[3]) : 1;
+	if(iterations < 1)
+		iterations = 1;
+
+	int dims[3];
+	unsigned char* data = stbi_load(fname, &dims[0], &dims[1], &dims[2], 1);
+	if(!data)
+	{
+		fprintf(stderr, "Couldn't open input image \"%s\"\n", fname);
+		exit(1);
+	}
+
+	clbp_Error e = {0};
+	CpuPipeline cpu;
+	allocCpuPipeline(&cpu, dims[0], dims[1], &e);
+	handleClBoilerplateError(e);
+
+	ThreadPool pool;
+	if(createThreadPool(&pool, thread_cnt, 256))
+	{
+		fprintf(stderr, "Couldn't start thread pool\n");
+		exit(1);
+	}
+	printf("%ix%i input, %u threads\n", dims[0], dims[1], pool.thread_cnt);
+
+	double totals[CPU_STAGE_CNT] = {0};
+	for(int i = 0; i < iterations; ++i)
+	{
+		runCpuPipeline(&cpu, &pool, data);
+		for(int j = 0; j < CPU_STAGE_CNT; ++j)
+			totals[j] += cpu.stage_ms[j];
+	}
+
+	double sum = 0;
+	for(int j = 0; j < CPU_STAGE_CNT; ++j)
+	{
+		printf("%-20s %9.3f ms\n", cpuStageNames[j], totals[j] / iterations);
+		sum += totals[j] / iterations;
+	}
+	printf("%-20s %9.3f ms\n", "total", sum);
+
+	size_t px_cnt = (size_t)dims[0] * dims[1];
+	uint32_t arc_cnt = 0;
+	for(size_t i = 0; i < px_cnt; ++i)
+		arc_cnt += cpu.seg_in_arc[i] >= 4;
+	printf("%u segment starts, %u arcs with an ellipse fit\n", cpu.start_cnt, arc_cnt);
+
+	// linked edge pixels in white, bases of fitted arcs in red
+	unsigned char* out_data = malloc(px_cnt * 3);
+	if(out_data)
+	{
+		for(size_t i = 0; i < px_cnt; ++i)
+		{
+			unsigned char edge = cpu.cont[i] ? 255 : 0;
+			out_data[i * 3] = cpu.seg_in_arc[i] >= 4 ? 255 : edge;
+			out_data[i * 3 + 1] = cpu.seg_in_arc[i] >= 4 ? 0 : edge;
+			out_data[i * 3 + 2] = cpu.seg_in_arc[i] >= 4 ? 0 : edge;
+		}
+		stbi_write_png("images/cpu_output.png", dims[0], dims[1], 3, out_data, dims[0] * 3);
+		free(out_data);
+	}
+
+	destroyThreadPool(&pool);
+	freeCpuPipeline(&cpu);
+	stbi_image_free(data);
+}
@@ -3,6 +3,7 @@
 #include <CL/cl.h>
 #include "cl_error_handlers.h"
 #include "cl_boilerplate.h"
+#define STBIW_DECLARATIONS_ONLY
 #include "stb_image_write.h"
 
 #define KERNEL_SRC_DIR "kernel/src/"
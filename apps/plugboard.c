@@ -1,11 +1,16 @@
 #include <stdio.h>
 #include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <CL/cl.h>
-#include "cl_error_handlers.h"
 #include "cl_boilerplate.h"
 #include "clbp_error_handling.h"
-#include "stb_image_write.h"
-#include "clbp_parse_manifest.h"
+#include "clbp_pipeline.h"
+#include "clbp_frame_prefetch.h"
+#include "clbp_raw_input.h"
+#include "thread_pool.h"
+#include "clbp_output_writer.h"
 
 #define KERNEL_DIR "kernel/"
 #define KERNEL_SRC_DIR	KERNEL_DIR"kern_src/"
@@ -13,153 +18,263 @@
 #define KERNEL_INC_SRC_DIR	KERNEL_DIR"inc_src/"
 #define INPUT_FNAME "images/input.png"
 #define OUTPUT_NAME "images/output"
+// how many frames can be decoded ahead of the one being processed
+#define PREFETCH_SLOTS 4
+// how many output images can be waiting to be written before the main loop blocks
+#define OUTPUT_SLOTS 4
 // atan2pi() used in gradient direction calc uses infinities internally for horizonal calculations
 // Intel CPUs seem to not calculate atan2pi() correctly if -cl-fast-relaxed-math is set and collapse to only either +/- 0.5
-#define KERNEL_GLOBAL_BUILD_ARGS "-I"KERNEL_INC_DIR" -Werror -g -cl-kernel-arg-info -cl-single-precision-constant -cl-fast-relaxed-math"
+#define KERNEL_COMMON_BUILD_ARGS "-I"KERNEL_INC_DIR" -Werror -cl-single-precision-constant -cl-fast-relaxed-math"
+// validation builds keep debug info and arg info so every kernel arg can be checked against the manifest
+#define KERNEL_GLOBAL_BUILD_ARGS KERNEL_COMMON_BUILD_ARGS" -g -cl-kernel-arg-info"
+// release builds leave the compiler free to optimize and take the arg access the last validation run saved instead
+#define KERNEL_RELEASE_BUILD_ARGS KERNEL_COMMON_BUILD_ARGS
+#define ARG_CACHE_FNAME KERNEL_DIR"arg_access.cache"
+// made by apps/compile_kernels.c, used by release runs instead of compiling from source if it exists
+#define KERNEL_BUNDLE_FNAME KERNEL_DIR"kernels.clbundle"
 //#define MAX_KERNELS 32
 //#define MAX_STAGES 32
 //#define MAX_ARGS 200
 
-//FIXME: need to think of this as a library since we want people to use this to track things
-// in their own programs, therefore, it can't be calling exit() in case of an error
+// set from a signal handler to request a read back of every output on the next frame
+static volatile sig_atomic_t capture_requested = 0;
 
-int main(int argc, char *argv[])
+#ifdef SIGUSR1
+static void onCaptureSignal(int sig)
 {
-	(void)argc;
-	char const* in_file[] = {
-		argv[1] ? argv[1] : INPUT_FNAME,
-		NULL
-	};
-	cl_int clErr;
+	(void)sig;
+	capture_requested = 1;
+	signal(SIGUSR1, onCaptureSignal);	// some platforms reset the handler after each signal
+}
+#endif
 
-	// Getting device, context, and command queue done first because if any of these fail, it's likely a higher priority issue
-	// than some part of the manifest being invalid since it's likely a hardware or driver issue
+// one line per ellipse: focus 1 x/y, focus 2 x/y, edge distance, supporting segment count, perimeter support ratio
+static void saveEllipseList(char const* fname, EllipseRecord const* list, uint32_t cnt, uint32_t total_cnt)
+{
+	FILE* file = fopen(fname, "w");
+	if(!file)
+	{
+		perror("Couldn't save ellipse list");
+		return;
+	}
+	if(total_cnt > cnt)
+		fprintf(file, "# %u ellipses detected, only the first %u fit in the list\n", total_cnt, cnt);
+	for(uint32_t i = 0; i < cnt; ++i)
+	{
+		cl_float const* f = list[i].foci.s;
+		fprintf(file, "%g %g %g %g %g %u %g\n", f[0], f[1], f[2], f[3], list[i].dist, list[i].seg_cnt, list[i].support);
+	}
+	fclose(file);
+}
 
-	// get a device to execute on
-	cl_device_id device = getPreferredDevice();
+// command line front end to clbp_pipeline.h that feeds it frames from files and saves its outputs,
+// unlike the pipeline itself this exits on any error
 
-	// Create a context
-	//TODO: this might be better generalized if the device list included all devices for a given platform
-//FIXME: specify platform here, right now it just happens to work because it defaults to the first returned platform
-	cl_context context = clCreateContext(NULL, 1, &device, NULL, NULL, &clErr);
-	handleClError(clErr, "clCreateContext");
+int main(int argc, char *argv[])
+{
+	// input can be a single image, a directory of frames, a .txt list of frames,
+	// or a raw .y4m/.pgm/.y8 stream where .y8 needs its frame size as a "<width>x<height>" argument,
+	// outputs are saved as png unless "pnm" or "raw" is given as an argument, both skip compression,
+	// "release" builds the kernels without debug and arg info using the arg access cached by the last run without it,
+	// "profile=<name>" stages only what the named [Profiles] entry of the manifest needs instead of its Profile key
+	char const* in_path = argc > 1 ? argv[1] : INPUT_FNAME;
+	int raw_dims[2] = {0};
+	enum outputFormat out_format = CLBP_OUT_PNG;
+	char is_release = 0;
+	char const* profile = NULL;
+	for(int i = 2; i < argc; ++i)
+	{
+		enum outputFormat format = parseOutputFormat(argv[i]);
+		if(format != CLBP_INVALID_OUT_FORMAT)
+			out_format = format;
+		else if(!strcmp(argv[i], "release"))
+			is_release = 1;
+		else if(!strncmp(argv[i], "profile=", 8))
+			profile = argv[i] + 8;
+		else
+			sscanf(argv[i], "%ix%i", &raw_dims[0], &raw_dims[1]);
+	}
+	clbp_Error e = {.err_code = CLBP_OK};
 
-	// Create the command queue
-	cl_command_queue queue = clCreateCommandQueue(context, device, 0, &clErr);
-	handleClError(clErr, "clCreateCommandQueue");
+	// raw streams are uploaded straight from a mapping of the file, anything else needs decoding so
+	// start decoding frames as early as possible so they're ready by the time the pipeline is built,
+	// either way the first frame gives the size the pipeline is built for
+	char is_raw = isRawFrameFile(in_path);
+	RawFrameFile raw = {0};
+	uint32_t frame_cnt = 0;
+	char** fnames = NULL;
+	ThreadPool pool = {0};
+	FramePrefetcher prefetcher = {0};
+	int width, height;
+	if(is_raw)
+	{
+		openRawFrameFile(&raw, in_path, raw_dims[0], raw_dims[1], &e);
+		handleClBoilerplateError(e);
+		frame_cnt = raw.frame_cnt;
+		width = raw.width;
+		height = raw.height;
+	}
+	else
+	{
+		fnames = listInputFiles(in_path, &frame_cnt, &e);
+		handleClBoilerplateError(e);
+		if(createThreadPool(&pool, 0, PREFETCH_SLOTS))
+			handleClBoilerplateError((clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "thread pool"});
+		createFramePrefetcher(&prefetcher, &pool, (char const**)fnames, frame_cnt, PREFETCH_SLOTS, 1, &e);
+		handleClBoilerplateError(e);
+		width = prefetcher.width;
+		height = prefetcher.height;
+	}
 
-	// Read + validate MANIFEST.toml to figure out which kernel programs we want compiled,
-	// how they should be scheduled, what arguments to feed them, and how those args should be formatted
-	// and setup a QStaging object that encapsulates that intent
-	clbp_Error e = {.err_code = CLBP_OK};
-	toml_table_t* root_tbl = parseManifestFile("MANIFEST.toml", &e);
-	handleClBoilerplateError(e);
-	QStaging staging = {.input_img_cnt = 1};
-	allocQStagingArrays(root_tbl, &staging, &e);
-	handleClBoilerplateError(e);
-	populateQStagingArrays(root_tbl, &staging, &e);
-	handleClBoilerplateError(e);
+	// device setup, manifest staging, kernel compilation and arg allocation all happen in here
 	//TODO: add QStaging caching so that if the manifest isn't changed, we don't have to re-parse everything
-
-	// compile and link kernel programs from source
-	// may be moved after calcRanges() if processing size plays a factor in the build process
-	// such as if there is only ever a single fixed size that is discovered at runtime
-	// tradeoff is it's worse for the memory footprint, but allows for minor optimization for the kernel program
 	//TODO: add support for individualized build args
-	cl_program linked_prog = buildKernelProgsFromSource(context, device, KERNEL_SRC_DIR, &staging, KERNEL_GLOBAL_BUILD_ARGS, &e);
-	handleClBoilerplateError(e);
-
-	//at this point, the arg list and kernel list are finalized and we know how many there will be
-	StagedQ staged;
-	e.err_code = allocStagedQArrays(&staging, &staged);
-	if(e.err_code)
-		e.detail = "Staged queue array allocation";
-	handleClBoilerplateError(e);
-
-	// instantiate hard-coded args, this gives us the base image sizes that things are calculated relative to
-	staging.img_arg_stg[0] = (ArgStaging){
-		.type = CL_MEM_OBJECT_IMAGE2D,
-		.format = {
-			.image_channel_order = CL_R,
-			.image_channel_data_type = CL_UNORM_INT8//CL_UNSIGNED_INT8
-		}
+	PipelineConfig cfg = {
+		.manifest_fname = "MANIFEST.toml",
+		.profile = profile,
+		.kernel_src_dir = KERNEL_SRC_DIR,
+		.kernel_bundle_fname = is_release ? KERNEL_BUNDLE_FNAME : NULL,
+		.build_args = is_release ? KERNEL_RELEASE_BUILD_ARGS : KERNEL_GLOBAL_BUILD_ARGS,
+		.arg_cache_fname = ARG_CACHE_FNAME,
+		.is_release = is_release,
+		.width = width,
+		.height = height
 	};
-
-	inputImagesFromFiles(in_file, &staging, &e);
-	handleClBoilerplateError(e);
-
-	// calculate arg sizes and kernel ranges, this allows baking of image sizes and kernel ranges into kernels if desired
-	calcRanges(&staging, &staged, &e);
+	Pipeline pipe;
+	createPipeline(&pipe, &cfg, &e);
 	handleClBoilerplateError(e);
+	StagedQ* staged = &pipe.staged;
 
-	// kernel arguments can't be queried before kernel instantiaion
-	instantiateKernels(&staging, linked_prog, &staged, &e);
-	handleClBoilerplateError(e);
-
-	// must be run once after first instantiation of kernels and before first instantiation of args
-	inferArgAccessAndVerifyFormats(&staging, &staged);
-
-	size_t max_out_sz = instantiateImgArgs(context, &staging, &staged, &e);
-	handleClBoilerplateError(e);
-
-	setKernelArgs(&staging, &staged, &e);
-	handleClBoilerplateError(e);
-
-	// cleanup now that config is fully processed
-	freeQStagingArrays(&staging);
-	toml_free(root_tbl);
-	//TODO: if you add multiple output tracking, then the sizes array of the StagedQ can be freed here
-
-	// safe to release the context here since it's never used after this point
-	clErr = clReleaseContext(context);
-	handleClError(clErr, "clReleaseContext");
-
-	//clErr = clUnloadCompiler();
-	//handleClError(clErr, "clUnloadCompiler");
+	// every image flagged as an output is saved whenever its readback is due, the pipeline already converts
+	// 2D ones to 8-bit channels on the device, when the compacted ellipse list is an output it's saved as text instead
+	uint16_t* outputs = malloc(staged->img_arg_cnt * sizeof(uint16_t));
+	if(!outputs)
+		handleClBoilerplateError((clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "output list"});
+	uint16_t output_cnt = 0;
+	size_t max_out_sz = 0;
+	for(uint16_t i = 0; i < staged->img_arg_cnt; ++i)
+	{
+		if(!(staged->arg_host_flags[i] & CLBP_AHF_OUTPUT) || pipe.staging.img_arg_stg[i].type == CL_MEM_OBJECT_BUFFER)
+			continue;
+		outputs[output_cnt++] = i;
+		size_t byte_cnt = getPipelineImageByteCnt(&pipe, i);
+		if(max_out_sz < byte_cnt)
+			max_out_sz = byte_cnt;
+	}
 
-	// allocate output buffer
-	char* out_data = (char*)malloc(max_out_sz);
-	if(!out_data)
-		handleClBoilerplateError((clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "output buffer"});
+	// allocate output buffers, images are handed off to the writer thread so they get a ring of them
+	EllipseRecord* ellipses = NULL;
+	uint32_t max_ellipse_cnt = 0;
+	OutputWriter writer = {0};
+	if(pipe.ellipse_list_idx >= 0)
+	{
+		max_ellipse_cnt = getPipelineImageByteCnt(&pipe, pipe.ellipse_list_idx) / sizeof(EllipseRecord);
+		ellipses = malloc(max_ellipse_cnt * sizeof(EllipseRecord));
+		if(!ellipses)
+			handleClBoilerplateError((clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "ellipse list"});
+	}
+	if(output_cnt)
+	{
+		createOutputWriter(&writer, OUTPUT_SLOTS, max_out_sz, out_format, &e);
+		handleClBoilerplateError(e);
+	}
 
+#ifdef SIGUSR1
+	// outputs with readback = 'on_demand' are saved for the frame after a SIGUSR1 is received, stages with
+	// sample = 'on_demand' are run for it
+	signal(SIGUSR1, onCaptureSignal);
+#endif
 	puts("\n");
 
 	//------ END OF INITIALIZATION ------//
 	//------- START OF MAIN LOOP -------//
 	//TODO: this eventually should be a camera feed driven loop
-
-	// enqueue kernels to the command queue
-	for(int i = 0; i < staged.stage_cnt; ++i)
+	uint32_t frame_idx = 0;
+	for(; frame_idx < frame_cnt; ++frame_idx)
 	{
-		size_t* range = staged.ranges[i].d;
-		//printf("Enqueueing ??? with range %zu*%zu*%zu.\n", /*staging.kprog_names[i],*/ range[0], range[1], range[2]);
-		clErr = clEnqueueNDRangeKernel(queue, staged.kernels[i], 2, NULL, range, NULL, 0, NULL, NULL);
-		handleClError(clErr, "clEnqueueNDRangeKernel");
-	}
+		// runs every stage due this frame, sampled stages only run on the frames they're due
+		if(is_raw)
+			processFrame(&pipe, raw.map + raw.frame_offsets[frame_idx], &e);
+		else
+		{
+			FrameSlot* frame = acquireFrame(&prefetcher, &e);
+			if(!frame)	// a frame failed to decode, e says why
+				break;
+			processFrame(&pipe, frame->data, &e);
+			// the frame was copied into the input image so its slot can start decoding the next one
+			releaseFrame(frame);
+		}
+		handleClBoilerplateError(e);
+
+		printf("\nProcessing frame %u of %s.\n", frame_idx, is_raw ? in_path : fnames[frame_idx]);
+		if(capture_requested)
+		{
+			capture_requested = 0;
+			for(uint16_t i = 0; i < staged->img_arg_cnt; ++i)
+				requestReadback(staged, i);
+			for(uint16_t i = 0; i < staged->stage_cnt; ++i)
+				triggerStage(staged, i);
+		}
+
+		char out_fname[64];
+		if(ellipses && consumeReadback(staged, pipe.ellipse_list_idx, frame_idx))
+		{
+			uint32_t total_cnt;
+			uint32_t cnt = readPipelineEllipses(&pipe, ellipses, max_ellipse_cnt, &total_cnt, &e);
+			handleClBoilerplateError(e);
+			printf("%u ellipse(s) detected.\n", total_cnt);
 
-	printf("\nProcessing image.\n");
-	//clFinish(queue);
-	size_t* out_sz = staged.img_sizes[staged.img_arg_cnt-1].d;
-	size_t region[3] = {out_sz[0], out_sz[1], out_sz[2]};
-	// Enqueue a data read back to the host and wait for it to complete
-	clErr = clEnqueueReadImage(queue, staged.img_args[staged.img_arg_cnt-1], CL_TRUE, (size_t[3]){0}, region, 0, 0, out_data, 0, NULL, NULL);
-	handleClError(clErr, "clEnqueueReadImage");
+			if(frame_cnt == 1)
+				snprintf(out_fname, sizeof(out_fname), OUTPUT_NAME"_ellipses.txt");
+			else
+				snprintf(out_fname, sizeof(out_fname), OUTPUT_NAME"_ellipses_%05u.txt", frame_idx);
+			saveEllipseList(out_fname, ellipses, cnt, total_cnt);
+		}
 
-	uint8_t channel_cnt = readImageAsCharArr(out_data, &staged, staged.img_arg_cnt-1);
+		// only the outputs that are due this frame get transferred
+		for(uint16_t i = 0; i < output_cnt; ++i)
+		{
+			uint16_t idx = outputs[i];
+			if(!consumeReadback(staged, idx, frame_idx))
+				continue;
 
-	// save result
-	//TODO: replace this with displaying or other processing
-	//NOTE: if channel_cnt == 2, then this gets interpreted as gray + alpha so may look strange simply viewing it
-	stbi_write_png(OUTPUT_NAME".png", out_sz[0], out_sz[1], channel_cnt, out_data, channel_cnt*out_sz[0]);
+			// only blocks if the writer has fallen OUTPUT_SLOTS images behind
+			OutputSlot* out = acquireOutputSlot(&writer);
+			uint8_t channel_cnt = readPipelineImage(&pipe, idx, out->data, &e);
+			handleClBoilerplateError(e);
+
+			// save result in the background, the writer adds the extension
+			// a lone output keeps the plain output name, otherwise the arg name tells them apart
+			//TODO: replace this with displaying or other processing
+			//NOTE: if channel_cnt == 2, then this gets interpreted as gray + alpha so may look strange simply viewing it
+			int len = snprintf(out_fname, sizeof(out_fname), (output_cnt == 1) ? OUTPUT_NAME : OUTPUT_NAME"_%s", pipe.staging.arg_names[idx]);
+			if(frame_cnt > 1 && len > 0 && (size_t)len < sizeof(out_fname))
+				snprintf(out_fname + len, sizeof(out_fname) - len, "_%05u", frame_idx);
+			size_t const* out_sz = staged->img_sizes[idx].d;
+			submitOutput(out, out_fname, out_sz[0], out_sz[1], channel_cnt);
+		}
+	}
+	handleClBoilerplateError(e);
 
 	//----------- END OF MAIN LOOP -----------//
 	//------ START OF DE-INITIALIZATION ------//
-	printf("\nSuccessfully processed image.\n");
+	printf("\nSuccessfully processed %u frame(s).\n", frame_idx);
 
-	// Deallocate resources
-	free(out_data);
-	freeStagedQArrays(&staged);
+	if(is_raw)
+		closeRawFrameFile(&raw);
+	else
+	{
+		destroyFramePrefetcher(&prefetcher);
+		destroyThreadPool(&pool);
+		freeInputFileList(fnames, frame_cnt);
+	}
 
-	clReleaseCommandQueue(queue);
-	handleClError(clErr, "clReleaseCommandQueue");
+	// Deallocate resources
+	// waits for any images still queued to be written
+	uint32_t write_fail_cnt = destroyOutputWriter(&writer);
+	if(write_fail_cnt)
+		fprintf(stderr, "\nWARNING: %u output image(s) couldn't be written.\n", write_fail_cnt);
+	free(ellipses);
+	free(outputs);
+	destroyPipeline(&pipe);
 }
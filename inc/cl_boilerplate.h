@@ -10,6 +10,12 @@
 #include <CL/cl.h>
 #include "clbp_public_typedefs.h"
 
+// mem flags for hard-coded input args, the device allocates host accessible memory that gets filled by writeInputImage(),
+// on devices that share memory with the host this avoids the staging copies that CL_MEM_COPY_HOST_PTR would make
+#define CLBP_INPUT_MEM_FLAGS	(CL_MEM_ALLOC_HOST_PTR | CL_MEM_HOST_WRITE_ONLY)
+
+// stages with a count_arg and no required work group size get their x range rounded up to a multiple of this
+#define CLBP_COUNT_GRANULE	64
 
 // attempts to get the first available GPU or if none available CPU
 //TODO: actually implement multiple attempts to find a GPU, currently just takes the first device of the first platform
@@ -32,6 +38,10 @@ cl_int allocStagedQArrays(QStaging const* staging, StagedQ* staged);
 // applies the relative calculations for all arg sizes starting from the first non-hardcoded input argument
 void calcRanges(QStaging const* staging, StagedQ* staged, clbp_Error* e);
 
+// prints the bytes each arg needs, the total, and every stage's NDRange, then checks them against the device's memory limits,
+// meant to be run after calcRanges() so oversized configurations are caught before anything gets allocated
+void planDeviceMemory(cl_device_id device, QStaging const* staging, StagedQ const* staged, clbp_Error* e);
+
 // handles using staging data to selectively open kernel program source files and compile and link them into a single program binary
 //TODO: add support for using pre-calculated ranges as defined constants
 cl_program buildKernelProgsFromSource(cl_context context, cl_device_id device, const char* src_dir, QStaging* staging, const char* args, clbp_Error* e);
@@ -41,19 +51,49 @@ void instantiateKernels(QStaging const* staging, const cl_program kprog, StagedQ
 
 // infers the access qualifiers of the image args as well as verifies that type data specified matches what the kernels expect of it
 // meant to be run once after kernels have been instantiated for at least 1 staged queue, additional staged queues don't
-// require re-runs of inferArgAccessAndVerifyFormats() since data extracted from the kernel instance args shouldn't change
-void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged);
+// require re-runs of inferArgAccessAndVerifyFormats() since data extracted from the kernel instance args shouldn't change,
+// needs kernels built with -cl-kernel-arg-info, if cache_fname isn't NULL the inferred access is saved there for applyCachedArgAccess()
+void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged, char const* cache_fname);
+
+// release build replacement for inferArgAccessAndVerifyFormats(), applies the access qualifiers it saved to cache_fname without
+// querying the kernels so they can be built without -cl-kernel-arg-info, none of the format verification is repeated
+void applyCachedArgAccess(QStaging* staging, char const* cache_fname, clbp_Error* e);
+
+// creates the device memory for arg idx at the given size from its staging data
+cl_mem createArgMem(cl_context context, QStaging const* staging, uint16_t idx, size_t const* size, clbp_Error* e);
 
 // fills in the ArgTracker according to the arg staging data in staging,
 // assumes the ArgTracker was allocated big enough not to overrun it and
 // is pre-populated with the expected number of hard-coded input entries
-// such that it may add the first new entry at input_img_cnt
+// such that it may add the first new entry at input_img_cnt, args only sampled stages use are deferred to scheduleSampledStages()
 size_t instantiateImgArgs(cl_context context, QStaging const* staging, StagedQ* staged, clbp_Error* e);
 
-// --returns the max number of bytes needed for reading out of any of the host readable buffers-- << not true anymore but might add back later
-//TODO: add support for returning a list of host readable buffers
+// binds the instantiated args to every stage, host readable outputs are the args flagged with CLBP_AHF_OUTPUT
 void setKernelArgs(QStaging const* staging, StagedQ* staged, clbp_Error* e);
 
+// sets arg idx again on every stage that uses it, for after it was replaced in staged->img_args
+void rebindArg(QStaging const* staging, StagedQ const* staged, uint16_t idx, clbp_Error* e);
+
+// flags output arg idx to be read back on the next frame regardless of its readback period
+void requestReadback(StagedQ* staged, uint16_t idx);
+
+// returns true if output arg idx should be read back after running frame_idx, clears any pending on demand request,
+// outputs that no stage produced this frame are never due and keep their request for the next frame that does
+char consumeReadback(StagedQ* staged, uint16_t idx, uint32_t frame_idx);
+
+// flags a sampled stage to run on the next scheduled frame regardless of its sample period, does nothing for other stages
+void triggerStage(StagedQ* staged, uint16_t stage_idx);
+
+// decides which sampled stages run on frame_idx and creates the deferred args they need the first time they run,
+// must be called before every enqueueStagedQ() of a queue with sampled stages or they never run,
+// staging has to be kept around for it and context has to be the one the queue's args were created in
+void scheduleSampledStages(cl_context context, QStaging const* staging, StagedQ* staged, uint32_t frame_idx, clbp_Error* e);
+
+// zero fills any args flagged with CLBP_AHF_CLEAR and then enqueues every stage of the staged queue in order,
+// stages skipped this frame and the args only they use are left out of both, stages with a count arg wait for it to be
+// read back and launch only as many work items as it says, rounded up, or none at all if it's 0
+void enqueueStagedQ(cl_command_queue queue, StagedQ const* staged, clbp_Error* e);
+
 // takes a NULL terminated array of KernStaging pointers and an array of kernels and fills in the QStage array and argTracker array
 // according to their details
 //void prepQStages(cl_context context, const QStaging* staging, const cl_program kprog, QStage* stages, ArgTracker* at, clbp_Error* e);
@@ -62,7 +102,32 @@ void setKernelArgs(QStaging const* staging, StagedQ* staged, clbp_Error* e);
 // must have the format and type pre-populated with a suitable way to interpret the raw image data
 void inputImagesFromFiles(char const** fnames, QStaging* staging, clbp_Error* e);
 
-// converts format of data to char array compatible read,
+// fills a hard-coded input arg with tightly packed host data by mapping it, meant to be used once per frame
+// after instantiateImgArgs(), data must match the format and size the arg was instantiated with
+void writeInputImage(cl_command_queue queue, StagedQ const* staged, uint16_t idx, uint8_t const* data, clbp_Error* e);
+
+// finds the count and list args of the most refined ellipse list marked as an output, merge_ellipses.cl then
+// verify_ellipses.cl then compact_ellipses.cl, returns false and sets both indices to -1 if none of them are
+char findEllipseListArgs(char const** arg_names, StagedQ const* staged, int* cnt_idx, int* list_idx);
+
+// reads back the ellipse list written by compact_ellipses.cl, reading the count first so only the used part of the list is transferred,
+// returns how many records were copied to out, total_cnt gets how many were detected including any that didn't fit
+uint32_t readEllipseList(cl_command_queue queue, StagedQ const* staged, uint16_t cnt_idx, uint16_t list_idx, EllipseRecord* out, uint32_t max_cnt, uint32_t* total_cnt, clbp_Error* e);
+
+// builds pack_uchar.cl from src_dir with defines matching the format of the image at idx so that it can be converted to
+// 8 bits per channel on the device, pr->kernel is left NULL without an error if the arg isn't a 2D image or is deferred
+void createPackedReadback(cl_context context, cl_device_id device, char const* src_dir, char const* args, StagedQ const* staged, uint16_t idx, PackedReadback* pr, clbp_Error* e);
+
+// points the packed readback at the current image at idx and at packed, which must hold its size in packed pixels,
+// the previous packed buffer is replaced without being released
+void setPackedReadbackTarget(StagedQ const* staged, uint16_t idx, PackedReadback* pr, cl_mem packed, clbp_Error* e);
+
+// packs the image on the device and reads back only the packed bytes, out must hold at least pr->byte_cnt bytes
+void readPackedImage(cl_command_queue queue, PackedReadback const* pr, uint8_t* out, clbp_Error* e);
+
+void releasePackedReadback(PackedReadback* pr);
+
+// converts format of data to char array compatible read, host side fallback for when createPackedReadback() can't be used,
 // data must point to a 32-bit aligned array. if it was malloc'd, it is aligned
 // returns channel count since it's often needed after this and is already called here
 uint8_t readImageAsCharArr(char* data, StagedQ const* staged, uint16_t idx);
@@ -9,6 +9,12 @@ enum clbp_ErrCode{
 	CLBP_FILE_NOT_FOUND,	// failed when attempting to open file, could be it doesn't exist or permissions
 	CLBP_INVALID_RANGEMODE,	// passed a non implemented RangeMode value to calcSizeByMode()
 	CLBP_INVALID_SIZE3D,	// calcSizeByMode() calculation resulted in an illegal 3D size where one or more elements were <= 0
+	CLBP_INVALID_FRAME_SIZE,// a frame of a multi-frame input didn't match the dimensions of the first frame
+	CLBP_INVALID_FRAME_FILE,// raw frame file had a malformed or unsupported header, or headerless input was missing its dimensions
+	CLBP_INSUFFICIENT_DEVICE_MEM,	// the args calculated for the manifest wouldn't fit in device memory
+	CLBP_INVALID_ARG_CACHE,	// arg access cache was malformed or made for a different stages array than the manifest's
+	CLBP_INVALID_KERNEL_BUNDLE,	// kernel bundle was malformed, from another bundle version, or built from different kernels or build args
+	CLBP_KERNEL_BUNDLE_WRONG_DEVICE,	// kernel bundle binary was built for a different device than the one loading it
 
 	// manifest parsing specific errors, all should be >= CLBP_MF_PARSING_FAILED
 	CLBP_MF_PARSING_FAILED,				// all toml-c errors get converted to this
@@ -23,6 +29,10 @@ enum clbp_ErrCode{
 	CLBP_MF_INVALID_ARG_TYPE,			// arg type specifier string didn't match a recognized type
 	CLBP_MF_REF_ARG_NOT_YET_STAGED,		// a staged arg referenced an arg that was not staged before it, either it doesn't exist or
 	CLBP_MF_INVALID_RANGEMODE,			// mode specified in a size or range field didn't match the known modes
+	CLBP_MF_INVALID_READBACK,			// readback must be a positive frame period or 'on_demand'
+	CLBP_MF_INVALID_PROFILE,			// selected profile isn't in [Profiles], has no outputs array, or no stage writes its outputs
+	CLBP_MF_INVALID_SAMPLE,				// sample must be a positive frame period or 'on_demand'
+	CLBP_MF_INVALID_COUNT_ARG,			// count_arg of a stage's range must be a staged single uint32 BUFFER
 };
 
 typedef struct {
@@ -0,0 +1,62 @@
+#ifndef CLBP_FRAME_PREFETCH_H
+#define CLBP_FRAME_PREFETCH_H
+/**
+ * Decodes upcoming input frames on a host thread pool into a bounded ring of reusable
+ * host buffers so that decoding overlaps with device execution. Frames are handed
+ * out in file list order regardless of which worker finished decoding first.
+ */
+#include <CL/cl.h>
+#include <pthread.h>
+#include "clbp_public_typedefs.h"
+#include "thread_pool.h"
+
+enum frameSlotState {
+	CLBP_FRAME_EMPTY = 0,	// free to be assigned the next frame
+	CLBP_FRAME_DECODING,	// owned by a pool worker
+	CLBP_FRAME_READY,		// decoded and waiting to be acquired
+	CLBP_FRAME_ACQUIRED,	// owned by the consumer until released
+	CLBP_FRAME_FAILED,		// decode failed or the frame didn't match the first frame's size
+};
+
+typedef struct FramePrefetcher FramePrefetcher;
+
+typedef struct {
+	FramePrefetcher* owner;
+	uint8_t* data;		// tightly packed frame_bytes long, allocated once for the lifetime of the prefetcher
+	uint32_t frame_idx;	// index into the file list of the frame held or being decoded
+	enum frameSlotState state;
+	cl_int err_code;	// reason for CLBP_FRAME_FAILED, either CLBP_FILE_NOT_FOUND or CLBP_INVALID_FRAME_SIZE
+} FrameSlot;
+
+struct FramePrefetcher {
+	ThreadPool* pool;
+	char const** fnames;
+	uint32_t frame_cnt;
+	uint32_t next_frame;	// next frame to be handed out by acquireFrame()
+	FrameSlot* slots;		// frame i always goes in slot i % slot_cnt
+	uint8_t slot_cnt;
+	uint8_t channels;
+	int width;				// dimensions of the first frame, every other frame must match
+	int height;
+	size_t frame_bytes;
+	pthread_mutex_t lock;
+	pthread_cond_t slot_changed;
+};
+
+// builds a file list from path, a directory gives all of its non-hidden files sorted by name,
+// a file ending in ".txt" gives one path per line, anything else is treated as a single frame
+// returned list and its strings are freed with freeInputFileList()
+char** listInputFiles(char const* path, uint32_t* cnt, clbp_Error* e);
+void freeInputFileList(char** list, uint32_t cnt);
+
+// decodes the first frame on the calling thread to size the ring and then starts decoding
+// the next slot_cnt - 1 frames on the pool, fnames must outlive the prefetcher
+void createFramePrefetcher(FramePrefetcher* fp, ThreadPool* pool, char const** fnames, uint32_t frame_cnt, uint8_t slot_cnt, uint8_t channels, clbp_Error* e);
+// blocks until the next frame in order has been decoded, returns NULL once all frames have been handed out
+FrameSlot* acquireFrame(FramePrefetcher* fp, clbp_Error* e);
+// hands the slot back to the ring, the frame should have been copied out with writeInputImage() first and queues the decode of the frame that will reuse it
+void releaseFrame(FrameSlot* slot);
+// waits for in-flight decodes and then frees the ring
+void destroyFramePrefetcher(FramePrefetcher* fp);
+
+#endif//CLBP_FRAME_PREFETCH_H
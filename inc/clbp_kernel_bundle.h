@@ -0,0 +1,45 @@
+#ifndef CLBP_KERNEL_BUNDLE_H
+#define CLBP_KERNEL_BUNDLE_H
+/**
+ * Prebuilt kernel programs saved by apps/compile_kernels.c so the runtime can skip compiling from source.
+ * A bundle is a fixed size header followed by a device binary, which only loads on the device it was built for.
+ * Bundles are tied to the kernel sources, includes and build args they were built from and are rejected
+ * if any of them change, the header is written in host byte order so bundles aren't portable across endianness.
+ */
+#include <stdint.h>
+#include <CL/cl.h>
+#include "clbp_public_typedefs.h"
+#include "clbp_error_handling.h"
+
+// bump whenever the header layout or the meaning of any of its fields changes
+#define CLBP_BUNDLE_VERSION	2
+#define CLBP_BUNDLE_MAGIC	"CLBPKB"
+
+enum kernelBundleKind {
+	CLBP_BUNDLE_BINARY,	// device executable from clGetProgramInfo()
+};
+
+typedef struct {
+	char magic[8];			// CLBP_BUNDLE_MAGIC, zero padded
+	uint32_t version;		// CLBP_BUNDLE_VERSION
+	uint32_t kind;			// enum kernelBundleKind
+	uint64_t build_hash;	// hashKernelBuild() of what it was built from
+	uint64_t payload_size;	// bytes of binary following the header
+	char device_name[128];	// CL_DEVICE_NAME of the device the binary was built for
+	char build_args[512];	// only kept for reporting, build args can't be changed without rebuilding the bundle
+} KernelBundleHeader;
+
+// FNV-1a hash of everything buildKernelProgsFromSource() compiles: the kernel program names in the order the manifest
+// uses them, their sources in src_dir, every file in the directories build_args adds with -I, and build_args itself
+//NOTE: files that can't be read are hashed as missing rather than reported, the compile that follows reports them
+uint64_t hashKernelBuild(QStaging const* staging, char const* src_dir, char const* build_args);
+
+// saves the linked program built for device by buildKernelProgsFromSource() as a binary bundle
+void saveKernelBundle(cl_program prog, cl_device_id device, QStaging const* staging, char const* src_dir, char const* build_args, char const* fname, clbp_Error* e);
+
+// loads a bundle saved by the above into a program ready for instantiateKernels(), replaces buildKernelProgsFromSource(),
+// the binary is only finalized for the device
+// src_dir and build_args must be what buildKernelProgsFromSource() would have been called with
+cl_program loadKernelBundle(cl_context context, cl_device_id device, QStaging const* staging, char const* src_dir, char const* build_args, char const* fname, clbp_Error* e);
+
+#endif//CLBP_KERNEL_BUNDLE_H
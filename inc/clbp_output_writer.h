@@ -0,0 +1,57 @@
+#ifndef CLBP_OUTPUT_WRITER_H
+#define CLBP_OUTPUT_WRITER_H
+/**
+ * Saves output images on a background thread so that encoding and disk writes overlap
+ * with processing of the next frame. Output buffers come from a bounded ring of slots,
+ * once every slot is waiting to be written, acquiring the next one blocks the caller.
+ */
+#include <stdint.h>
+#include <pthread.h>
+#include "clbp_error_handling.h"
+#include "thread_pool.h"
+
+enum outputFormat {
+	CLBP_OUT_PNG = 0,	// deflate compressed, slow enough to throttle the pipeline when saving every frame
+	CLBP_OUT_PNM,		// uncompressed binary PGM for 1 channel, PPM for 3 and PAM for 2 or 4
+	CLBP_OUT_RAW,		// tightly packed pixels with no header, same layout as the .y8 input for 1 channel
+	CLBP_INVALID_OUT_FORMAT
+};
+extern char const* outputFormatNames[CLBP_INVALID_OUT_FORMAT+1];
+
+typedef struct OutputWriter OutputWriter;
+
+typedef struct {
+	OutputWriter* owner;
+	uint8_t* data;		// buf_bytes long, filled by the caller between acquireOutputSlot() and submitOutput()
+	char fname[256];
+	int width;
+	int height;
+	uint8_t channel_cnt;
+	char is_queued;		// set while the slot is waiting to be or being written
+} OutputSlot;
+
+struct OutputWriter {
+	ThreadPool pool;		// single worker so files are written in the order they were submitted
+	OutputSlot* slots;
+	uint8_t slot_cnt;
+	uint8_t next_slot;
+	enum outputFormat format;
+	size_t buf_bytes;
+	uint32_t fail_cnt;		// number of files that couldn't be written
+	pthread_mutex_t lock;
+	pthread_cond_t slot_freed;
+};
+
+// returns the format matching str (ie. "png", "pnm" or "raw") or CLBP_INVALID_OUT_FORMAT if none match
+enum outputFormat parseOutputFormat(char const* str);
+
+// allocates slot_cnt output buffers of buf_bytes each and starts the writer thread
+void createOutputWriter(OutputWriter* ow, uint8_t slot_cnt, size_t buf_bytes, enum outputFormat format, clbp_Error* e);
+// returns the next slot in the ring, blocks while its previous contents are still waiting to be written
+OutputSlot* acquireOutputSlot(OutputWriter* ow);
+// queues the slot's data to be saved as base_name with the extension of the writer's format appended
+void submitOutput(OutputSlot* slot, char const* base_name, int width, int height, uint8_t channel_cnt);
+// waits for queued writes to finish and then frees the slots, returns how many writes failed
+uint32_t destroyOutputWriter(OutputWriter* ow);
+
+#endif//CLBP_OUTPUT_WRITER_H
@@ -3,4 +3,7 @@
 
 toml_table_t* parseManifestFile(char* fname, clbp_Error* e);
 void allocQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clbp_Error* e);
+// keeps only the stages that lead to the outputs of a [Profiles] entry, profile NULL uses the manifest's Profile key,
+// run between allocQStagingArrays() and populateQStagingArrays(), reads the kernel sources in src_dir for which args they write
+void selectStageProfile(const toml_table_t* root_tbl, char const* profile, char const* src_dir, QStaging* staging, clbp_Error* e);
 void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clbp_Error* e);
\ No newline at end of file
@@ -0,0 +1,92 @@
+#ifndef CLBP_PIPELINE_H
+#define CLBP_PIPELINE_H
+/**
+ * In-process staged queue for programs that embed the detector instead of running plugboard once per image.
+ * Device setup, manifest parsing and kernel compilation are paid once in createPipeline() and then any number
+ * of frames of the same size can be run through it. Nothing here exits, every failure is returned through
+ * clbp_Error and a pipeline that failed to be created is still safe to pass to destroyPipeline().
+ * Frames of a different size need a resizePipeline() first, which keeps the last few sizes around so streams
+ * that alternate between resolutions don't reallocate every time they switch.
+ */
+#include <stdint.h>
+#include <CL/cl.h>
+#include "clbp_public_typedefs.h"
+#include "clbp_error_handling.h"
+#include "toml.h"
+
+typedef struct {
+	char const* manifest_fname;		// ie. "MANIFEST.toml"
+	char const* profile;			// [Profiles] entry of the manifest to stage, NULL for the manifest's Profile key
+	char const* kernel_src_dir;		// directory the stage kernel sources are read from
+	char const* kernel_bundle_fname;// prebuilt kernels from apps/compile_kernels.c used instead of the sources if the file exists, NULL to always compile
+	char const* build_args;			// passed to every kernel compile and link, must include the kernel include directory
+									// and -cl-kernel-arg-info unless is_release is set
+	char const* arg_cache_fname;	// where the kernel arg access is saved when inferred or loaded from when is_release is set, NULL to not cache it
+	char is_release;				// take the arg access from arg_cache_fname instead of querying kernels, see applyCachedArgAccess()
+	cl_device_id device;			// device to run on, NULL picks the first GPU of the first platform, falling back to any device
+	int width;						// size of the 1 channel 8-bit frames that will be processed
+	int height;
+} PipelineConfig;
+
+// how many inactive frame sizes resizePipeline() keeps the args of
+#define PIPELINE_SIZE_CACHE_CNT	3
+
+// args of a frame size that isn't currently in use, holds its own reference to every mem object in args
+typedef struct {
+	int width;				// 0 marks an unused entry
+	int height;
+	uint32_t last_used;		// resize_cnt when this size was last switched away from, the oldest gets evicted first
+	Size3D* sizes;			// img_arg_cnt arg sizes followed by stage_cnt NDRanges
+	cl_mem* args;			// img_arg_cnt args followed by img_arg_cnt packed readback buffers, NULL where there isn't one
+} PipelineSizeConfig;
+
+typedef struct {
+	cl_device_id device;
+	cl_context context;
+	cl_command_queue queue;
+	cl_program program;
+	toml_table_t* manifest;		// kept since the staging names point into it
+	QStaging staging;			// kept so arg names can be looked up and sizes recalculated
+	StagedQ staged;
+	PackedReadback* packers;	// one per arg, kernel is NULL for anything that isn't a 2D image output
+	uint32_t frame_idx;			// index of the next frame to be processed
+	int width;					// frame size the staged args are currently sized for
+	int height;
+	uint32_t resize_cnt;
+	PipelineSizeConfig size_cache[PIPELINE_SIZE_CACHE_CNT];
+	int ellipse_cnt_idx;		// most refined ellipse list marked as an output, -1 if there isn't one
+	int ellipse_list_idx;
+	char is_staged;				// staged arrays were allocated and need to be released
+} Pipeline;
+
+// builds everything needed to process frames of the configured size
+void createPipeline(Pipeline* p, PipelineConfig const* cfg, clbp_Error* e);
+
+// uploads a tightly packed width * height frame, runs every stage due this frame and waits for them to finish,
+// outputs can then be read with the functions below, consumeReadback(&p->staged, idx, p->frame_idx - 1) tells
+// whether an output is due according to its manifest readback period, triggerStage(&p->staged, idx) runs a
+// sampled stage on the next frame regardless of its manifest sample period
+void processFrame(Pipeline* p, uint8_t const* frame, clbp_Error* e);
+
+// switches the pipeline to frames of a different size, only the args and NDRanges whose calculated size changed are
+// swapped out and only the stages using them get their args set again, the previous size is cached for switching back,
+// on failure the pipeline is left at its previous size
+//NOTE: sizes that were read or written before stay valid only until the next resize, re-query getPipelineImageByteCnt()
+void resizePipeline(Pipeline* p, int width, int height, clbp_Error* e);
+
+// returns the index of the named arg or -1 if the manifest doesn't use it
+int getPipelineArgIndex(Pipeline const* p, char const* name);
+
+// bytes needed to read the arg at idx with readPipelineImage()
+size_t getPipelineImageByteCnt(Pipeline const* p, uint16_t idx);
+
+// reads the image at idx as 8 bits per channel into out and returns its channel count, 0 on error
+uint8_t readPipelineImage(Pipeline* p, uint16_t idx, uint8_t* out, clbp_Error* e);
+
+// reads the ellipse list the manifest marks as an output, see readEllipseList()
+uint32_t readPipelineEllipses(Pipeline* p, EllipseRecord* out, uint32_t max_cnt, uint32_t* total_cnt, clbp_Error* e);
+
+// releases everything the pipeline holds, including after a failed createPipeline()
+void destroyPipeline(Pipeline* p);
+
+#endif//CLBP_PIPELINE_H
@@ -17,6 +17,7 @@ enum rangeMode {
 	CLBP_RM_ROW,		// add/subtract on y axis, exact on x and z
 	CLBP_RM_COLUMN,		// add/subtract on x axis, exact on y and z
 	CLBP_RM_DIAGONAL,	// exact on [0], contraction(- only, + no useful effect) relative to length of diagonal on [1]*, add/subtract on [2], used for hough_lines
+	CLBP_RM_DIVIDE_CEIL,// divides each component by corresponding param rounding up, used for pyramid levels so edge pixels aren't dropped
 //	PAD,	// pad to multiple of work group dimensions
 //	SINGLE,	// meant for primarily serial workloads, [0] == false -> 1 hardware workgroup, [0] == true -> single work item
 	CLBP_INVALID_MODE
@@ -44,12 +45,50 @@ typedef struct {
 	enum rangeMode mode;	// what mode to calculate the NDRange/size_t[3] in
 } RangeData;
 
+// host side handling of args that can't be conveyed through cl_mem_flags
+enum argHostFlags {
+	CLBP_AHF_CLEAR = 1,	// zero filled before every run of the staged queue, ie. atomic counters and sparse outputs
+	CLBP_AHF_OUTPUT = 2,	// host readable output, read back according to its readback period
+	CLBP_AHF_READ_REQUESTED = 4,	// an on demand read back of the output was requested for the next frame
+	CLBP_AHF_DEFERRED = 8,	// only used by sampled stages, not created until the first frame that runs one of them
+	CLBP_AHF_IDLE = 16,		// no stage using it runs this frame so it's neither cleared nor read back
+};
+
+// count_idx of stages whose range isn't capped by a count written on the device
+#define CLBP_NO_COUNT_ARG	UINT16_MAX
+
+// host side scheduling of stages that don't run every frame
+enum stageHostFlags {
+	CLBP_SHF_SKIP = 1,		// left out of the current frame, set by scheduleSampledStages()
+	CLBP_SHF_TRIGGERED = 2,	// a run of a sampled stage was requested for the next frame
+};
+
+// host side layout of a record written by compact_ellipses.cl and verify_ellipses.cl
+typedef struct {
+	cl_float4 foci;		// absolute coordinates of both foci, x/y of the first followed by x/y of the second
+	cl_float dist;		// sum of the distances from any point on the ellipse to both foci
+	cl_uint seg_cnt;	// number of line segments supporting the ellipse
+	cl_float support;	// fraction of sampled perimeter points with a matching edge pixel, 0 if it wasn't verified
+	cl_float pad;
+} EllipseRecord;
+
+// device side conversion of an image arg into tightly packed 8-bit channels, built from pack_uchar.cl
+typedef struct {
+	cl_kernel kernel;		// NULL if the image couldn't be packed on the device and needs readImageAsCharArr() instead
+	cl_mem packed;			// host readable buffer the kernel writes the packed pixels to
+	size_t range[2];		// width and height of the image
+	size_t byte_cnt;		// size of packed, the host buffer it's read into must be at least this big
+	uint8_t channel_cnt;	// channels per packed pixel
+} PackedReadback;
+
 // used to track fixed arg settings that stay constant between instances of a staged queue, regardless of image size
 typedef struct {
 	cl_mem_object_type type;// indicates what broad type of argument this should be
 //	RangeData size;			// data on how to calculate the size_t[3] of the arg
 	cl_mem_flags flags;		// stores flag state to be assigned to eventual cl_mem object at creation, some from manifest, some from kernel arg queries
-	cl_image_format format;	// used for verifying compatible channel types, spacing and read/write operations
+	cl_image_format format;	// used for verifying compatible channel types, spacing and read/write operations, for buffers it's the element type
+	uint8_t host_flags;		// bitfield of enum argHostFlags
+	uint16_t readback_period;	// for outputs, read back every Nth frame, 0 for only on demand
 } ArgStaging;	//TODO: since stbi only supports 8 bit depth the host readable flag forces 8 bit output which may cause calculation issues if buffer isn't last
 
 // user provided info of how to set up kernels in a queue and their arguments
@@ -57,6 +96,8 @@ typedef struct {
 //	RangeData range;		// data on how to calculate the NDRange
 	uint16_t kernel_idx;	// index of the kernel program name
 	uint16_t arg_cnt;		// cached count of how many arguments this kernel requests
+	uint16_t sample_period;	// run every Nth frame, 1 for every frame and 0 for only when triggered, see scheduleSampledStages()
+	uint16_t count_idx;		// arg holding how many work items the stage's x range actually needs, CLBP_NO_COUNT_ARG if it doesn't have one
 	uint16_t* arg_idxs;		// array containing indices for each arg to use, freed when using freeQStagingArrays()
 } KernStaging;
 
@@ -72,6 +113,7 @@ typedef struct {
 	char** arg_names;			// array of kernel program argument names that get used for the stages
 	ArgStaging* img_arg_stg;	// arg staging array listing details about type of arg
 	RangeData* arg_size_calcs;	// array of RangeData for each image arg that specifies how to calculate the image size
+	uint8_t* stage_mask;		// optional, one entry per stage of the manifest, populateQStagingArrays() skips the 0 ones
 } QStaging;
 /*
 // info used in assigning an arg to kernels, creating/reading buffers on the host, and deallocating mem objects
@@ -96,8 +138,14 @@ typedef struct {
 	uint16_t img_arg_cnt;	// how many args the img_args array contains
 	cl_kernel* kernels;		// array of kernel instances corresponding to each stage
 	Size3D* ranges;			// array of 3D ranges to enque the matching kernel index with
+	Size3D* local_ranges;	// array of work group sizes from each kernel's reqd_work_group_size attribute, all 0 to let the implementation pick
 	cl_mem* img_args;		// array of all image args associated with the kernel
 	Size3D* img_sizes;		// array of images sizes corresponding to each arg
+	uint8_t* arg_host_flags;// array of enum argHostFlags bitfields corresponding to each arg
+	uint16_t* readback_periods;	// array of readback periods corresponding to each arg, only used by CLBP_AHF_OUTPUT args
+	uint8_t* stage_host_flags;	// array of enum stageHostFlags bitfields corresponding to each stage
+	uint16_t* sample_periods;	// array of sample periods corresponding to each stage, 1 for stages that run every frame
+	uint16_t* count_args;		// array of count arg indices corresponding to each stage, CLBP_NO_COUNT_ARG for fixed ranges
 } StagedQ;
 
 #endif//CLBP_PUBLIC_TYPEDEFS_H
\ No newline at end of file
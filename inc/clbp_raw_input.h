@@ -0,0 +1,41 @@
+#ifndef CLBP_RAW_INPUT_H
+#define CLBP_RAW_INPUT_H
+/**
+ * Memory-mapped readers for uncompressed greyscale frame streams, frames are uploaded
+ * straight out of the mapping so there's no decode or intermediate host copy.
+ * Supported formats by extension:
+ *	.y4m	YUV4MPEG2 with 8-bit samples, only the luma plane of each frame is used
+ *	.pgm	one or more binary (P5) 8-bit PGM images concatenated back to back
+ *	.y8		headerless 8-bit luma frames back to back, dimensions must be given
+ */
+#include <CL/cl.h>
+#include "clbp_public_typedefs.h"
+
+enum rawFrameFormat {
+	CLBP_RAW_Y4M,
+	CLBP_RAW_PGM,
+	CLBP_RAW_Y8,
+};
+
+typedef struct {
+	uint8_t const* map;		// read only mapping of the whole file
+	size_t map_len;
+	size_t* frame_offsets;	// byte offset of each frame's luma plane into the mapping
+	uint32_t frame_cnt;
+	int width;
+	int height;
+	enum rawFrameFormat format;
+#ifdef _WIN32
+	void* file_handle;
+	void* mapping_handle;
+#endif
+} RawFrameFile;
+
+// returns true if the file name has an extension handled by the raw readers
+char isRawFrameFile(char const* fname);
+// maps the file and indexes its frames, width and height are only used for headerless Y8, anything
+// without a .y4m or .pgm extension is treated as Y8
+void openRawFrameFile(RawFrameFile* raw, char const* fname, int width, int height, clbp_Error* e);
+void closeRawFrameFile(RawFrameFile* raw);
+
+#endif//CLBP_RAW_INPUT_H
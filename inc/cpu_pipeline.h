@@ -0,0 +1,51 @@
+#ifndef CPU_PIPELINE_H
+#define CPU_PIPELINE_H
+/**
+ * Multi-threaded host implementation of the production kernel chain
+ * (scharr3_char -> non_max_sup -> link_edge_pixels -> find_segment_starts ->
+ * serial_reduce -> line_segments -> arc_builder), meant as a reference for checking
+ * kernel output and as a baseline for measuring the OpenCL speedups. Buffers use the
+ * same per pixel layouts as the images of the matching kernel args.
+ */
+#include <stdint.h>
+#include "clbp_error_handling.h"
+#include "thread_pool.h"
+
+// must match the size of start_coords in MANIFEST.toml
+#define CPU_MAX_STARTS	16384
+
+enum cpuStage {
+	CPU_SCHARR,
+	CPU_NON_MAX_SUP,
+	CPU_LINK_EDGES,
+	CPU_FIND_STARTS,
+	CPU_SERIAL_REDUCE,
+	CPU_LINE_SEGMENTS,
+	CPU_ARC_BUILDER,
+	CPU_STAGE_CNT
+};
+
+extern char const* cpuStageNames[CPU_STAGE_CNT];
+
+typedef struct {
+	int width;
+	int height;
+	uint8_t* grad;			// uc2_grad: angle, magnitude
+	int8_t* grad_ang;		// ic1_grad_ang
+	uint8_t* cont;			// uc1_cont
+	uint8_t* starts_cont;	// uc1_starts_cont
+	int16_t* start_coords;	// is2_start_coords, x and y interleaved
+	uint16_t start_cnt;
+	int8_t* line_data;		// ic2_line_data, x and y interleaved
+	uint16_t* line_cnts;	// us1_line_counts
+	uint16_t* seg_in_arc;	// us1_seg_in_arc
+	float* ellipse_foci;	// ff4_ellipse_foci
+	double stage_ms[CPU_STAGE_CNT];	// wall clock time of each stage during the last run
+} CpuPipeline;
+
+void allocCpuPipeline(CpuPipeline* cpu, int width, int height, clbp_Error* e);
+// runs every stage on a width x height 8-bit greyscale image, stages are split across the pool's workers
+void runCpuPipeline(CpuPipeline* cpu, ThreadPool* pool, uint8_t const* input);
+void freeCpuPipeline(CpuPipeline* cpu);
+
+#endif//CPU_PIPELINE_H
@@ -542,7 +542,9 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 //
 ////   end header file   /////////////////////////////////////////////////////
 #endif // STBI_INCLUDE_STB_IMAGE_H
+#ifndef STBI_DECLARATIONS_ONLY	// lets other files use the implementation compiled into cl_boilerplate.c
 #define STB_IMAGE_IMPLEMENTATION
+#endif
 #ifdef STB_IMAGE_IMPLEMENTATION
 
 #if defined(STBI_ONLY_JPEG) || defined(STBI_ONLY_PNG) || defined(STBI_ONLY_BMP) \
@@ -195,7 +195,9 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 
 #endif//INCLUDE_STB_IMAGE_WRITE_H
+#ifndef STBIW_DECLARATIONS_ONLY	// lets other files use the implementation compiled into clbp_output_writer.c
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+#endif
 #ifdef STB_IMAGE_WRITE_IMPLEMENTATION
 
 #ifdef _WIN32
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+/**
+ * Minimal fixed size pthreads worker pool used by the host side helpers (CPU reference
+ * pipeline, input prefetching, output writing, etc.), jobs are run in submission order
+ * by whichever worker picks them up first
+ */
+#include <stdint.h>
+#include <pthread.h>
+
+typedef void (*JobFunc)(void* arg);
+
+typedef struct {
+	JobFunc func;
+	void* arg;
+} ThreadPoolJob;
+
+typedef struct {
+	pthread_t* threads;
+	ThreadPoolJob* jobs;	// ring buffer of pending jobs
+	pthread_mutex_t lock;
+	pthread_cond_t job_ready;	// signalled when a job is queued or on shutdown
+	pthread_cond_t job_done;	// signalled when the last outstanding job completes or a queue slot frees up
+	uint32_t job_cap;
+	uint32_t job_head;
+	uint32_t job_cnt;		// jobs queued but not yet picked up
+	uint32_t active_cnt;	// jobs picked up but not yet completed
+	uint16_t thread_cnt;
+	char is_shutdown;
+} ThreadPool;
+
+// returns the number of hardware threads available to the process, at least 1
+uint16_t getHostThreadCount();
+
+// starts thread_cnt workers (0 for one per hardware thread) with room for job_cap pending jobs,
+// returns 0 on success
+int createThreadPool(ThreadPool* pool, uint16_t thread_cnt, uint32_t job_cap);
+// queues a job, blocks while the pending job queue is full
+void submitJob(ThreadPool* pool, JobFunc func, void* arg);
+// blocks until every submitted job has completed
+void waitForJobs(ThreadPool* pool);
+// waits for outstanding jobs and then joins and frees the workers
+void destroyThreadPool(ThreadPool* pool);
+
+// splits rows [0, height) into roughly equal bands and runs func once per band on the pool,
+// blocks until all bands are done, ctx is shared by all bands
+typedef void (*BandFunc)(void* ctx, int y_start, int y_end);
+void runBands(ThreadPool* pool, int height, BandFunc func, void* ctx);
+
+#endif//THREAD_POOL_H
@@ -0,0 +1,113 @@
+#ifndef ADJ_CANDIDATES_CL
+#define ADJ_CANDIDATES_CL
+
+#include "math_helpers.cl"
+
+// tracks the 2 nearest adjacency candidates for each turning direction of a segment,
+// candidates are ordered by distance and then by index so that the final selection doesn't depend
+// on the order they were visited in, this allows the brute force and grid searches to match exactly
+struct adj_candidates {
+	uint idx[2][2];		// [is_ccw][0: nearest, 1: 2nd nearest], -1 if not found
+	uint dist2[2][2];	// squared distance from the end of the segment to the start of the candidate
+};
+
+inline void adj_init(private struct adj_candidates* c)
+{
+	for(int i = 0; i < 4; ++i)
+	{
+		c->idx[i >> 1][i & 1] = -1;
+		c->dist2[i >> 1][i & 1] = -1;
+	}
+}
+
+inline char adj_is_closer(uint dist2, uint idx, uint ref_dist2, uint ref_idx)
+{
+	return dist2 < ref_dist2 || (dist2 == ref_dist2 && idx < ref_idx);
+}
+
+inline void adj_insert(private struct adj_candidates* c, uchar side, uint dist2, uint idx)
+{
+	if(!adj_is_closer(dist2, idx, c->dist2[side][1], c->idx[side][1]))
+		return;
+
+	if(adj_is_closer(dist2, idx, c->dist2[side][0], c->idx[side][0]))
+	{	// new nearest, old nearest becomes 2nd nearest
+		c->idx[side][1] = c->idx[side][0];
+		c->dist2[side][1] = c->dist2[side][0];
+		c->idx[side][0] = idx;
+		c->dist2[side][0] = dist2;
+		return;
+	}
+	c->idx[side][1] = idx;
+	c->dist2[side][1] = dist2;
+}
+
+// anything further than this can't displace a candidate on either side anymore
+inline uint adj_search_bound(private const struct adj_candidates* c)
+{
+	return max(c->dist2[0][1], c->dist2[1][1]);
+}
+
+// adjacency checks that only need the start of segment B, returns the squared distance
+// from the end of segment A to the start of segment B if it passes, otherwise -1
+//TODO: revisit these checks once you understand the Candy's Theorem constraint, should be more efficient
+inline uint adj_check_start(private const struct adj_candidates* c, int2 A_end, int2 A_end_offset, uint chord_dist2, int2 B_start)
+{
+	int2 A_to_B = B_start - A_end;	// vector from end of segment A to start of segment B
+	uint dist2 = mag2_2d_i(A_to_B);
+	// if it's at or above the max search radius away from the end,
+	// skip it, it's not likely part of the same ellipse,
+	// also prevents it from including itself
+	if(dist2 >= chord_dist2 || dist2 > adj_search_bound(c))
+		return -1;
+
+	// if start of segment B isn't forward of the end of segment A,
+	// A_to_B will have a component against the direction of A_end_offset
+	// so dot product will be negative, indicating it should be skipped
+	if(dot_2d_i(A_end_offset, A_to_B) < 0)
+		return -1;
+
+	return dist2;
+}
+
+// remaining adjacency checks that need the offset of segment B (index i), saves it as a candidate if it passes
+inline void adj_check_offset(private struct adj_candidates* c, int2 A_end, int2 A_end_offset, int2 B_start, int2 B_end_offset, uint dist2, uint i)
+{
+	// angle between segments A and B must be acute, ie positive dot product
+	if(dot_2d_i(A_end_offset, B_end_offset) <= 0)
+		return;
+
+	int dir = cross_2d_i(A_end_offset, B_end_offset);
+	// anti-joggle check, the turning direction of the segment offsets must
+	// match that of the line between them, meaning the product of the 2 must be non-negative
+	if(dir * cross_2d_i(A_end_offset, B_start - A_end) < 0)
+		return;
+
+	// could add a B chord len search region check here for better symmetry but it would be mostly redundant
+
+	// all checks passed, save candidate, segments with no turn are candidates for both sides
+	if(dir >= 0)
+		adj_insert(c, 0, dist2, i);
+	if(dir <= 0)
+		adj_insert(c, 1, dist2, i);
+}
+
+// runs the adjacency checks for segment B (index i) against segment A and saves it as a candidate if it passes,
+// B's offset is only read from the image if the cheaper start checks pass
+inline void adj_test_candidate(private struct adj_candidates* c, read_only image2d_t iC2_line_data,
+	int2 A_end, int2 A_end_offset, uint chord_dist2, int2 B_start, uint i)
+{
+	uint dist2 = adj_check_start(c, A_end, A_end_offset, chord_dist2, B_start);
+	if(dist2 == (uint)-1)
+		return;
+
+	adj_check_offset(c, A_end, A_end_offset, B_start, read_imagei(iC2_line_data, B_start).lo, dist2, i);
+}
+
+// output is the nearest and 2nd nearest of the clockwise side followed by the same for the counter-clockwise side
+inline uint4 adj_to_uint4(private const struct adj_candidates* c)
+{
+	return (uint4)(c->idx[0][0], c->idx[0][1], c->idx[1][0], c->idx[1][1]);
+}
+
+#endif//ADJ_CANDIDATES_CL
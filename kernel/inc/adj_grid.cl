@@ -0,0 +1,28 @@
+#ifndef ADJ_GRID_CL
+#define ADJ_GRID_CL
+// uniform grid over segment start points used to limit the arc_adj_matrix neighbor search to nearby cells,
+// grid dimensions are the full resolution image dims divided by the cell size rounded down, pixels in the
+// remainder are clamped into the last row/column of cells so the grid buffers can be sized in the manifest
+// using DIVIDE mode with params of [1 << ADJ_GRID_CELL_SHIFT, 1 << ADJ_GRID_CELL_SHIFT, 1]
+
+#ifndef ADJ_GRID_CELL_SHIFT
+#define ADJ_GRID_CELL_SHIFT	4	// 16x16 pixel cells
+#endif//ADJ_GRID_CELL_SHIFT
+
+inline int2 adj_grid_dims(int2 img_dims)
+{
+	return max(img_dims >> ADJ_GRID_CELL_SHIFT, 1);
+}
+
+// cell coordinates of a pixel, clamped so that out of bounds search regions still land on the grid
+inline int2 adj_grid_cell(int2 coords, int2 grid_dims)
+{
+	return clamp(coords >> ADJ_GRID_CELL_SHIFT, (int2)0, grid_dims - 1);
+}
+
+inline uint adj_grid_index(int2 cell, int2 grid_dims)
+{
+	return cell.y * grid_dims.x + cell.x;
+}
+
+#endif//ADJ_GRID_CL
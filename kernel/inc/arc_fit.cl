@@ -0,0 +1,267 @@
+#ifndef ARC_FIT_CL
+#define ARC_FIT_CL
+
+#include "math_helpers.cl"
+//FIXME: come back and convert floats to floats where possible
+constant const char order[8] = {0,1,2,3,0,2,1,3};
+
+// calculates a ellipse through 5 points where 1 point is (0,0) and the rest are relative to it
+// returns the foci coordinates, distance from foci to edge is implied
+// if the conic through 5 points would not be an ellipse, returns NaN
+float4 ellipse_from_hist(private const int2 diffs[4], private const int cross_prods[4])
+{	//TODO: see how to mitigate rounding errors better
+	float4 foci;
+	float2 ca, ed, rs, temp_f2;
+	float b, temp_f, inv_2t, ac_diff;
+	float u, v;
+	int2 temp_i2;
+
+	// Fix to prevent exponent overflow from too many multiplication steps by pre-scaling the u and v values
+	// technically it might be safer to divide by the avg exponent between the max and non-zero-min of the coefficients,
+	// but dividing by a constant power of 2 is faster and should work in most cases, especially if resolution is kept
+	// to reasonable values (ie roughly <= 4069)
+	//FIXME: max guaranteed safe divisor with -cl-denorms-are-zero set is 2147483648 (2^31), need to add defines that take that into account
+	u =  (cross_prods[1] * cross_prods[3]) / 137438953472.0f;	// bias exponent by dividing by 2^37, max safe value without losing fine resolution
+	v = -(cross_prods[0] * cross_prods[2]) / 137438953472.0f;	// compiler should hopefully optimize this to simple exponent setting since it's a power of 2
+
+	ca = u * convert_float2(diffs[0] * diffs[2]) + v * convert_float2(diffs[1] * diffs[3]);
+	temp_i2 = diffs[0] * diffs[2].yx;
+	b = u * (float)(temp_i2.x + temp_i2.y);
+	temp_i2 = diffs[1] * diffs[3].yx;
+	b += v * (float)(temp_i2.x + temp_i2.y);
+
+	inv_2t = (4 * ca.x * ca.y - b * b);
+	//only bother computing foci for ellipse candidates, not parabolas or hyperbolas
+	if(inv_2t <= 0)
+		return NAN;
+
+	b = -b;
+	inv_2t = 1 / inv_2t;
+
+	ed = u * (cross_prods[0] * convert_float2(diffs[2]) + cross_prods[2] * convert_float2(diffs[0]))\
+		+v * (cross_prods[1] * convert_float2(diffs[3]) + cross_prods[3] * convert_float2(diffs[1]));
+	ed.x = -ed.x;
+
+	rs = b * ed;			//b[e, d]
+	temp_f = rs.x * ed.y;	//bed
+	temp_f2 = ca * ed.yx;	//[cd, ae]
+	rs -= 2 * temp_f2;		//b[e, d] - 2[cd, ae]
+	ac_diff = ca.y - ca.x;	//a-c
+
+	temp_f = 2 * (temp_f - dot_2d_f(temp_f2, ed.yx));	//2(bed - ae^2 - cd^2)
+	temp_f2 = sqrt(temp_f * (hypot(ac_diff, b) + (float2)(ac_diff, -ac_diff)));
+
+	// due to sqrt of complex value, x and y components are either same sign if b > 0 or opposite sign if b < 0
+	if(b < 0)
+		temp_f2.y *= -1;
+
+	foci.lo = rs - temp_f2;
+	foci.hi = rs + temp_f2;
+	foci *= inv_2t;
+
+	return convert_float4(foci);
+}
+
+inline float get_ellipse_dist(const float4 foci)
+{
+	return fast_length(foci.lo) + fast_length(foci.hi);
+}
+
+inline char is_near_ellipse_edge(const float4 foci, const float dist, const float2 point)
+{
+	return fabs(dist - (fast_distance(point, foci.lo) + fast_distance(point, foci.hi))) < 2;
+}
+
+// everything a single work item needs to fit elliptical arcs to a chain of line segments,
+// kept together so the same fitting steps can be driven by different scheduling schemes
+struct arc_state {
+	int2 base_coords;		// start of the current arc
+	int2 total_offset;		// offset from base_coords to the start of curr_seg
+	int2 curr_seg;			// offset from start to end of the most recently read segment
+	int2 prev_seg;
+	int2 points[4];			// segment endpoints relative to base_coords used in the current fit
+	int2 diffs[4];
+	int cross_prods[4];
+	float4 foci;
+	float edge_dist;
+	ushort seg_cnt;
+	char reset;				// 1: logical reset pending, 2: first solve reset pending
+	char dir_trend;
+	uchar kick;
+};
+
+// starts a new chain at base_coords where first_seg is the segment stored at base_coords
+inline void arc_init(private struct arc_state* s, int2 base_coords, int2 first_seg)
+{
+	s->base_coords = base_coords;
+	s->total_offset = 0;
+	s->curr_seg = first_seg;
+	s->seg_cnt = 1;
+	s->reset = 0;
+	s->dir_trend = 0;
+	s->kick = 0;
+}
+
+// writes out the segment count of the current arc and its foci if it was long enough to calculate an ellipse
+inline void arc_write(private const struct arc_state* s, write_only image2d_t us1_seg_in_arc, write_only image2d_t ff4_ellipse_foci)
+{
+	write_imageui(us1_seg_in_arc, s->base_coords, s->seg_cnt);
+	if(s->seg_cnt >= 4)
+	{
+		float2 base_f = convert_float2(s->base_coords);
+		write_imagef(ff4_ellipse_foci, s->base_coords, s->foci + (float4)(base_f, base_f));
+	}
+}
+
+// applies any reset left pending by the last segment and advances past the current segment,
+// returns the coordinates that the next segment of the chain starts at
+int2 arc_advance(private struct arc_state* s, write_only image2d_t us1_seg_in_arc, write_only image2d_t ff4_ellipse_foci)
+{
+	switch(s->reset)
+	{
+	case 1:	// logical reset, last read segment can't be part of the same elliptical arc
+		arc_write(s, us1_seg_in_arc, ff4_ellipse_foci);
+		s->reset = 0;
+		s->base_coords += s->total_offset;
+		s->total_offset = 0;	//keep last segment that caused the reset
+		s->seg_cnt = 1;
+		s->dir_trend = 0;	//trend unknown since only 1 segment
+		break;
+	case 2:	// first solve reset, at time of adding 4th segment, failed to get a valid ellipse fit
+		s->reset = 0;
+		// kick first segment and copy things down 1 slot to try again
+		write_imageui(us1_seg_in_arc, s->base_coords, 1);
+		int2 first_point = s->points[0];
+		s->base_coords += first_point;	// advance base coords by first segment
+		s->total_offset -= first_point;
+		s->points[0] = s->points[1] - first_point;	// remove first segment's offset to account for new base coord
+		s->points[1] = s->points[2] - first_point;
+		s->points[2] = s->points[3] - first_point;
+		s->diffs[0] = s->diffs[1];
+		s->diffs[1] = s->diffs[2];
+		s->diffs[2] = s->diffs[3];
+	}
+	s->prev_seg = s->curr_seg;
+	s->total_offset += s->curr_seg;
+	return s->base_coords + s->total_offset;
+}
+
+// attempts to extend the current arc with the segment read from the coordinates returned by arc_advance(),
+// flags a reset to be handled on the next advance if it couldn't be part of the same elliptical arc
+void arc_push_segment(private struct arc_state* s, int2 curr_seg)
+{
+	s->curr_seg = curr_seg;
+	int2 prev_seg = s->prev_seg;
+	int2 total_offset = s->total_offset;
+	private int2* points = s->points;
+	private int2* diffs = s->diffs;
+	private int* cross_prods = s->cross_prods;
+
+	// angle difference between segments A and B must be acute (no sharp corners), ie positive dot product
+	int dir_dot = dot_2d_i(prev_seg, curr_seg);
+	if(dir_dot <= 0)
+	{
+		s->reset = 1;	//set reset flag
+		return;
+	}
+
+	// angle between segments was more than 45 degrees
+	int dir_cross = cross_2d_i(prev_seg, curr_seg);
+	if(abs(dir_cross) > dir_dot)
+	{
+		s->reset = 1;
+		return;
+	}
+
+	char dir = (dir_cross < 0) ? -1 : dir_cross > 0;	//extract sign of dir_cross to get just the curving direction
+	// if curving direction changes between +/- trigger a reset
+	if((dir ^ s->dir_trend) == -2)
+	{
+		s->reset = 1;
+		return;
+	}
+	// if curving direction hasn't yet collapsed to +/-1, attempt to do so
+	if(!s->dir_trend)
+		s->dir_trend = dir;
+
+	// if we have not yet added enough segments to compute an ellipse
+	if(s->seg_cnt <= 3)
+	{
+		// add them to the calculation cache
+		points[s->seg_cnt-1] = total_offset;
+		diffs[s->seg_cnt] = curr_seg;
+
+		//on the attempt to add the 4th segment (currently has 3 segments)
+		// we finally have enough points to attempt calculating the ellipse
+		if(s->seg_cnt == 3)
+		{
+			points[3] = total_offset + curr_seg;
+			//attempt to solve for ellipse and check if first segment matches
+			diffs[0] = points[0] - points[3];
+			cross_prods[0] = cross_2d_i(points[0], points[3]);
+			cross_prods[1] = cross_2d_i(points[1], points[0]);
+			cross_prods[2] = cross_2d_i(points[2], points[1]);
+			cross_prods[3] = cross_2d_i(points[3], points[2]);
+
+			s->foci = ellipse_from_hist(diffs, cross_prods);
+
+			// if points didn't form an ellipse
+			if(!isfinite(s->foci.x))
+			{
+				s->reset = 2;
+				return;	//return without advancing segment count
+			}
+
+			s->edge_dist = get_ellipse_dist(s->foci);
+			float2 mid0 = convert_float2(points[0]) / 2;
+			// if the ellipse was a bad fit, try again next time
+			if(!is_near_ellipse_edge(s->foci, s->edge_dist, mid0))
+			{
+				s->reset = 2;
+				return;	//return without advancing segment count
+			}
+		}
+	}
+	else
+	{
+		// if the new segment endpoint deviates from the already calculated ellipse,
+		// it either needs to be re-calculated with the new point or reset and written out
+		if(!is_near_ellipse_edge(s->foci, s->edge_dist, convert_float2(total_offset)))
+		{
+			// lookup which entry to kick to attempt a re-calculation of the ellipse
+			// the ordering is chosen so that it should spread the points out as recaluclations occur
+			char k = order[s->kick++];
+			s->kick &= 7;
+			char k_m1 = (k - 1) & 3;
+			char k_p1 = (k + 1) & 3;
+			float2 old_point = convert_float2(points[k]);
+			points[k] = total_offset;
+			diffs[k] = points[k] - points[k_m1];
+			diffs[k_p1] =  points[k_p1] - points[k];
+			cross_prods[k] = cross_2d_i(points[k], points[k_m1]);
+			cross_prods[k_p1] = cross_2d_i(points[k_p1], points[k]);
+
+			// calculate the ellipse with the new point
+			float4 new_foci = ellipse_from_hist(diffs, cross_prods);
+			if(!isfinite(new_foci.x))
+			{
+				s->reset = 1;
+				return;
+			}
+			float new_dist = get_ellipse_dist(new_foci);
+			// if the new calculation wouldn't include the old point, it needs to be written out and reset
+			if(!is_near_ellipse_edge(new_foci, new_dist, old_point))
+			{
+				s->reset = 1;
+				return;
+			}
+			// else this was just a minor course correction and can be taken as the updated ellipse approx.
+			s->foci = new_foci;
+			s->edge_dist = new_dist;
+		}
+	}
+	// this must stay at the end b/c some situations need to be able to skip it
+	++s->seg_cnt;
+}
+
+#endif//ARC_FIT_CL
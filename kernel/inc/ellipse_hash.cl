@@ -0,0 +1,48 @@
+#ifndef ELLIPSE_HASH_CL
+#define ELLIPSE_HASH_CL
+// spatial hash over ellipse candidates used by hash_ellipses.cl and merge_ellipses.cl to find the duplicates that come
+// from arc_builder fitting each arc of the same ellipse independently, cells are keyed on the midpoint of the foci and
+// the edge distance since both are independent of which focus ended up first, buckets are a fixed number of slots
+// so the tables can be sized in the manifest, see the ellipse_buckets and ellipse_bucket_items args
+
+#ifndef ELLIPSE_LIST_CAPACITY
+#define ELLIPSE_LIST_CAPACITY	4096
+#endif//ELLIPSE_LIST_CAPACITY
+// bucket count must be a power of 2 and match the size of ellipse_buckets, slots * buckets the size of ellipse_bucket_items
+#ifndef ELLIPSE_HASH_BUCKETS
+#define ELLIPSE_HASH_BUCKETS	4096
+#endif//ELLIPSE_HASH_BUCKETS
+#ifndef ELLIPSE_HASH_SLOTS
+#define ELLIPSE_HASH_SLOTS		8
+#endif//ELLIPSE_HASH_SLOTS
+// max distance in pixels between matching foci and between edge distances for 2 candidates to be merged,
+// cells must be at least this big so that every match is in the same or an adjacent cell
+#ifndef ELLIPSE_MERGE_TOL
+#define ELLIPSE_MERGE_TOL		4.0f
+#endif//ELLIPSE_MERGE_TOL
+#define ELLIPSE_HASH_CELL		(2 * ELLIPSE_MERGE_TOL)
+
+inline int3 ellipse_hash_cell(float4 foci, float dist)
+{
+	float2 center = (foci.lo + foci.hi) / 2;
+	return convert_int3_rtn((float3)(center, dist / 2) / ELLIPSE_HASH_CELL);
+}
+
+inline uint ellipse_hash_bucket(int3 cell)
+{
+	return ((uint)cell.x * 73856093u ^ (uint)cell.y * 19349663u ^ (uint)cell.z * 83492791u) & (ELLIPSE_HASH_BUCKETS - 1);
+}
+
+// returns 0 if b isn't a duplicate of a, 1 if it is with matching focus order and -1 if it is with the foci swapped
+inline char ellipse_match(float4 a, float dist_a, float4 b, float dist_b)
+{
+	if(fabs(dist_a - dist_b) >= ELLIPSE_MERGE_TOL)
+		return 0;
+	float direct = max(fast_distance(a.lo, b.lo), fast_distance(a.hi, b.hi));
+	float swapped = max(fast_distance(a.lo, b.hi), fast_distance(a.hi, b.lo));
+	if(min(direct, swapped) >= ELLIPSE_MERGE_TOL)
+		return 0;
+	return direct <= swapped ? 1 : -1;
+}
+
+#endif//ELLIPSE_HASH_CL
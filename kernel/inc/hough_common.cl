@@ -0,0 +1,61 @@
+#ifndef HOUGH_COMMON_CL
+#define HOUGH_COMMON_CL
+// shared by hough_lines_local.cl and hough_line_suppress.cl so both agree on the accumulator layout,
+// the accumulator is a BUFFER of [ANGLE_RES][rho_res] uint votes where theta covers 0 to 180 degrees
+// (lines are undirected so gradient angles 180 degrees apart vote into the same bin) and rho is the
+// signed distance from the center of the image, offset by rho_res/2 so it's always positive
+
+// how many bits of resolution for the Hough transform's angle dimension, must be pre-defined at compile time
+// so the local histograms can be statically sized, grad_ang only has 6 bits of angle over 180 degrees so
+// anything above that relies on HOUGH_SPREAD to fill in the bins between input angles
+#ifndef ANGLE_BITS
+#define ANGLE_BITS			6
+#endif//ANGLE_BITS
+#define ANGLE_RES			(1<<ANGLE_BITS)
+#define ANGLE_SCALE			(M_PI_F/ANGLE_RES)
+
+// how many angle bins to either side of an edge pixel's own gradient angle it also votes for, absorbs angular noise
+#ifndef HOUGH_SPREAD
+#define HOUGH_SPREAD		1
+#endif//HOUGH_SPREAD
+
+// returns the theta bin for an 8-bit gradient angle, the top bit only flips the direction so it's dropped
+inline int hough_theta_bin(char grad_ang)
+{
+#if ANGLE_BITS <= 7
+	return ((uchar)grad_ang & 0x7F) >> (7 - ANGLE_BITS);
+#else
+	return ((uchar)grad_ang & 0x7F) << (ANGLE_BITS - 7);
+#endif
+}
+
+// unit normal of the line for theta bin t
+inline float2 hough_normal(int t)
+{
+	float c;
+	float s = sincos(t * ANGLE_SCALE, &c);
+	return (float2)(c, s);
+}
+
+// height of the rho dimension, must match the host's DIAGONAL range mode with a param[1] of 0 for the
+// accumulator arg, buffers can't be queried for their size so this recomputes it the same way the host does,
+// the host truncates a double precision sqrt which is exact for integers this small, a float sqrt isn't
+// (even less so under -cl-fast-relaxed-math) so its estimate is corrected to the exact integer square root
+inline int hough_rho_res(int2 dims)
+{
+	int len2 = dims.x * dims.x + dims.y * dims.y;
+	int rho = convert_int_rtz(sqrt(convert_float(len2)));
+	while(rho * rho > len2)
+		--rho;
+	while((rho + 1) * (rho + 1) <= len2)
+		++rho;
+	return rho & -2;
+}
+
+// rho bin of p, a position relative to the center of the image, for the line normal n, may be out of range
+inline int hough_rho_bin(float2 p, float2 n, int rho_res)
+{
+	return convert_int_rtn(dot(p, n)) + rho_res / 2;
+}
+
+#endif//HOUGH_COMMON_CL
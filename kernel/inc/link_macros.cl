@@ -24,4 +24,11 @@
 // "R" is occupancy/right continuation indicator flag, and	//NOTE: may deprecate this flag in favor of just the "E" flag
 // "rrr" is the 3-bit offset direction index of the right continuation
 
+//NOTE: packed edge records written by link_edge_pixels_packed.cl are 2 channel int8 in the form
+// .x = grad_ang, the 7-bit angle with the low bit as the occupancy flag, same as non_max_sup.cl writes,
+// .y = cont_data, the link bits in the link_edge_pixels.cl form above,
+// so kernels that need both at the same coordinates only fetch once
+#define EDGE_REC_ANG(rec)	((char)(rec).x)
+#define EDGE_REC_CONT(rec)	((uchar)(rec).y)
+
 #endif//LINK_MACROS_CL
\ No newline at end of file
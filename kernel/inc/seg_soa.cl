@@ -0,0 +1,24 @@
+#ifndef SEG_SOA_CL
+#define SEG_SOA_CL
+// structure of arrays segment store written by line_segments_soa, segments of each chain are stored contiguously
+// in start list order, so the n-th segment of the store is the same as the n-th entry of serial_reduce_lines' output
+// chain spans are (offset, count) into the store for each entry of the start list
+// there's no per-segment chain ID array, since chains are contiguous a segment's chain is the start list entry whose
+// span contains its index, consumers go chain to segments through the spans and nothing needs the reverse lookup
+
+// max number of segments the store can hold, must match the size of the store buffers in the manifest
+#ifndef SEG_SOA_CAPACITY
+#define SEG_SOA_CAPACITY	65536
+#endif//SEG_SOA_CAPACITY
+
+inline int2 soa_seg_start(global const short* is1_seg_start_x, global const short* is1_seg_start_y, uint i)
+{
+	return (int2)(is1_seg_start_x[i], is1_seg_start_y[i]);
+}
+
+inline int2 soa_seg_offset(global const char* ic1_seg_offset_x, global const char* ic1_seg_offset_y, uint i)
+{
+	return (int2)(ic1_seg_offset_x[i], ic1_seg_offset_y[i]);
+}
+
+#endif//SEG_SOA_CL
@@ -0,0 +1,20 @@
+#include "cast_helpers.cl"
+#include "adj_grid.cl"
+// first pass of the counting sort that builds the arc_adj_matrix_grid spatial index,
+// counts how many segments start in each grid cell
+//NOTE: must be scheduled with the same dims as iS2_line_coords, ui1_grid_counts must be zeroed before each run
+
+kernel void adj_grid_count(
+	read_only image2d_t iC2_line_data,
+	read_only image2d_t iS2_line_coords,
+	read_only image1d_t us1_length,
+	global uint* ui1_grid_counts)
+{
+	int2 indices = (int2)(get_global_id(0), get_global_id(1));
+	if(((indices.y << 8) | indices.x) >= read_imageui(us1_length, 0).x)
+		return;
+
+	int2 grid_dims = adj_grid_dims(get_image_dim(iC2_line_data));
+	int2 start = read_imagei(iS2_line_coords, indices).lo;
+	atomic_inc(&ui1_grid_counts[adj_grid_index(adj_grid_cell(start, grid_dims), grid_dims)]);
+}
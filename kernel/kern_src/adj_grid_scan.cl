@@ -0,0 +1,25 @@
+#include "adj_grid.cl"
+// second pass of the counting sort that builds the arc_adj_matrix_grid spatial index,
+// converts the per cell counts into the [start, end) range of each cell in the sorted segment list
+//NOTE: must be scheduled as 1D using EXACT rangeMode with param {1,1,1}
+//TODO: grid is only a few thousand cells at typical resolutions so serial is fine for now,
+// but this could be a single work group scan in local memory if it ever shows up in profiling
+
+kernel void adj_grid_scan(
+	read_only image2d_t iC2_line_data,
+	global const uint* ui1_grid_counts,
+	global uint2* ui2_grid_ranges)
+{
+	if(get_global_id(0))	// only thread 0 proccesses anything here
+		return;
+
+	int2 grid_dims = adj_grid_dims(get_image_dim(iC2_line_data));
+	uint cell_cnt = grid_dims.x * grid_dims.y;
+	uint sum = 0;
+	for(uint i = 0; i < cell_cnt; ++i)
+	{
+		uint count = ui1_grid_counts[i];
+		ui2_grid_ranges[i] = (uint2)(sum, sum + count);
+		sum += count;
+	}
+}
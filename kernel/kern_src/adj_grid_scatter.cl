@@ -0,0 +1,26 @@
+#include "cast_helpers.cl"
+#include "adj_grid.cl"
+// last pass of the counting sort that builds the arc_adj_matrix_grid spatial index,
+// places each segment index into its cell's range of the sorted list, consumes the counts from adj_grid_count
+// in the process so they end up zeroed again, order within a cell is arbitrary
+//NOTE: must be scheduled with the same dims as iS2_line_coords
+
+kernel void adj_grid_scatter(
+	read_only image2d_t iC2_line_data,
+	read_only image2d_t iS2_line_coords,
+	read_only image1d_t us1_length,
+	global uint* ui1_grid_counts,
+	global const uint2* ui2_grid_ranges,
+	global uint* ui1_grid_segs)
+{
+	int2 indices = (int2)(get_global_id(0), get_global_id(1));
+	uint index = (indices.y << 8) | indices.x;
+	if(index >= read_imageui(us1_length, 0).x)
+		return;
+
+	int2 grid_dims = adj_grid_dims(get_image_dim(iC2_line_data));
+	int2 start = read_imagei(iS2_line_coords, indices).lo;
+	uint cell = adj_grid_index(adj_grid_cell(start, grid_dims), grid_dims);
+	uint slot = ui2_grid_ranges[cell].x + atomic_dec(&ui1_grid_counts[cell]) - 1;
+	ui1_grid_segs[slot] = index;
+}
@@ -0,0 +1,52 @@
+#include "cast_helpers.cl"
+#include "adj_candidates.cl"
+#include "adj_grid.cl"
+// spatially indexed version of arc_adj_matrix, only segments starting in grid cells that overlap the
+// search radius around the end of segment A are tested instead of every segment, the index is built by
+// adj_grid_count, adj_grid_scan and adj_grid_scatter
+//NOTE: must be scheduled with the same dims as iS2_line_coords
+
+kernel void arc_adj_matrix_grid(
+	read_only image2d_t iC2_line_data,
+	read_only image2d_t iS2_line_coords,
+	read_only image1d_t us1_length,
+	global const uint2* ui2_grid_ranges,
+	global const uint* ui1_grid_segs,
+	write_only image2d_t us4_sparse_adj_matrix)
+{
+	int2 indices = (int2)(get_global_id(0), get_global_id(1));
+
+	// only process valid entries
+	if(((indices.y << 8) | indices.x) >= read_imageui(us1_length, 0).x)
+		return;
+
+	int2 A_start = read_imagei(iS2_line_coords, indices).lo;
+	int2 A_end_offset = read_imagei(iC2_line_data, A_start).lo;
+	int2 A_end = A_start + A_end_offset;
+	uint chord_dist2 = mag2_2d_i(A_end_offset);
+
+	struct adj_candidates c;
+	adj_init(&c);
+
+	// candidates must be strictly closer than the chord length of A so only cells within that radius can contain them
+	int radius = (int)sqrt((float)chord_dist2) + 1;
+	int2 grid_dims = adj_grid_dims(get_image_dim(iC2_line_data));
+	int2 cell_min = adj_grid_cell(A_end - radius, grid_dims);
+	int2 cell_max = adj_grid_cell(A_end + radius, grid_dims);
+
+	for(int2 cell = cell_min; cell.y <= cell_max.y; ++cell.y)
+	{
+		for(cell.x = cell_min.x; cell.x <= cell_max.x; ++cell.x)
+		{
+			uint2 range = ui2_grid_ranges[adj_grid_index(cell, grid_dims)];
+			for(uint j = range.x; j < range.y; ++j)
+			{
+				uint i = ui1_grid_segs[j];
+				int2 B_start = read_imagei(iS2_line_coords, SPLIT_INDEX(i)).lo;
+				adj_test_candidate(&c, iC2_line_data, A_end, A_end_offset, chord_dist2, B_start, i);
+			}
+		}
+	}
+
+	write_imageui(us4_sparse_adj_matrix, indices, adj_to_uint4(&c));
+}
@@ -0,0 +1,43 @@
+#include "cast_helpers.cl"
+#include "adj_candidates.cl"
+#include "seg_soa.cl"
+// structure of arrays variant of arc_adj_matrix, every work item walks the segment store in the same order so
+// the reads of segment B are broadcast across the work group instead of being scattered image reads,
+// segment indices match those of serial_reduce_lines so the output is identical to arc_adj_matrix
+//NOTE: must be scheduled as 1D using EXACT rangeMode with param {SEG_SOA_CAPACITY,1,1}
+
+kernel void arc_adj_matrix_soa(
+	global const uint* ui1_seg_total,
+	global const short* is1_seg_start_x,
+	global const short* is1_seg_start_y,
+	global const char* ic1_seg_offset_x,
+	global const char* ic1_seg_offset_y,
+	write_only image2d_t us4_sparse_adj_matrix)
+{
+	uint index = get_global_id(0);
+	uint seg_cnt = ui1_seg_total[0];
+
+	// only process valid entries
+	if(index >= seg_cnt)
+		return;
+
+	int2 A_start = soa_seg_start(is1_seg_start_x, is1_seg_start_y, index);
+	int2 A_end_offset = soa_seg_offset(ic1_seg_offset_x, ic1_seg_offset_y, index);
+	int2 A_end = A_start + A_end_offset;
+	uint chord_dist2 = mag2_2d_i(A_end_offset);
+
+	struct adj_candidates c;
+	adj_init(&c);
+
+	for(uint i = 0; i < seg_cnt; ++i)
+	{
+		int2 B_start = soa_seg_start(is1_seg_start_x, is1_seg_start_y, i);
+		uint dist2 = adj_check_start(&c, A_end, A_end_offset, chord_dist2, B_start);
+		if(dist2 == (uint)-1)
+			continue;
+
+		adj_check_offset(&c, A_end, A_end_offset, B_start, soa_seg_offset(ic1_seg_offset_x, ic1_seg_offset_y, i), dist2, i);
+	}
+
+	write_imageui(us4_sparse_adj_matrix, SPLIT_INDEX(index), adj_to_uint4(&c));
+}
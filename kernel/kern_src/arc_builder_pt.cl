@@ -0,0 +1,51 @@
+#include "cast_helpers.cl"
+#include "arc_fit.cl"
+// persistent threads variant of arc_builder, instead of 1 work item per start, a fixed number of work items
+// are launched that each keep pulling the next unprocessed start off of a shared counter as soon as they finish
+// their current chain, each loop iteration handles exactly 1 segment for every work item so lanes that got
+// short chains don't sit idle waiting on the lane in their SIMD group with the longest chain
+//NOTE: must be scheduled as 1D with a fixed range of roughly the number of work items the device can keep resident,
+// ui1_work_head must be zeroed before each run (is_cleared in the manifest)
+
+kernel void arc_builder_pt(
+	read_only image1d_t is2_start_coords,
+	read_only image2d_t ic2_line_data,
+	read_only image1d_t us1_line_counts,
+	global uint* ui1_work_head,
+	write_only image2d_t us1_seg_in_arc,
+	write_only image2d_t ff4_ellipse_foci)
+{
+	uint max_index = get_image_width(is2_start_coords);
+	struct arc_state s;
+	int remaining_segs = 0;
+
+	for(;;)
+	{
+		// out of segments for the current chain, pull the next one
+		if(!remaining_segs)
+		{
+			uint index = atomic_inc(ui1_work_head);
+			if(index >= max_index)
+				break;
+
+			int2 base_coords = read_imagei(is2_start_coords, index).lo;
+			// start list is compacted by serial_reduce so the first empty entry means there's nothing left to pull
+			if(!((union l_conv)base_coords).l)
+				break;
+
+			remaining_segs = read_imageui(us1_line_counts, index).x;
+			if(!remaining_segs)
+				continue;
+
+			arc_init(&s, base_coords, read_imagei(ic2_line_data, base_coords).lo);
+		}
+
+		if(--remaining_segs)
+		{
+			int2 seg_coords = arc_advance(&s, us1_seg_in_arc, ff4_ellipse_foci);
+			arc_push_segment(&s, read_imagei(ic2_line_data, seg_coords).lo);
+		}
+		else	//flush last arc of the chain
+			arc_write(&s, us1_seg_in_arc, ff4_ellipse_foci);
+	}
+}
@@ -0,0 +1,40 @@
+#include "cast_helpers.cl"
+#include "arc_fit.cl"
+#include "seg_soa.cl"
+// structure of arrays variant of arc_builder, reads each chain's segments sequentially from the segment store
+// written by line_segments_soa instead of following them through ic2_line_data, output is identical to arc_builder
+//NOTE: must be scheduled based on dims of is2_start_coords
+
+kernel void arc_builder_soa(
+	read_only image1d_t is2_start_coords,
+	global const uint2* ui2_chain_spans,
+	global const short* is1_seg_start_x,
+	global const short* is1_seg_start_y,
+	global const char* ic1_seg_offset_x,
+	global const char* ic1_seg_offset_y,
+	write_only image2d_t us1_seg_in_arc,
+	write_only image2d_t ff4_ellipse_foci)
+{
+	int index = get_global_id(0);	// must be scheduled as 1D
+
+	if(!((union l_conv)read_imagei(is2_start_coords, index).lo).l)
+		return;
+
+	uint2 span = ui2_chain_spans[index];
+	if(!span.y)	// chain didn't fit in the segment store
+		return;
+
+	struct arc_state s;
+	uint i = span.x;
+	arc_init(&s, soa_seg_start(is1_seg_start_x, is1_seg_start_y, i), soa_seg_offset(ic1_seg_offset_x, ic1_seg_offset_y, i));
+
+	// segment positions are implied by the store order so the coords returned by arc_advance() aren't needed
+	for(++i; i < span.x + span.y; ++i)
+	{
+		arc_advance(&s, us1_seg_in_arc, ff4_ellipse_foci);
+		arc_push_segment(&s, soa_seg_offset(ic1_seg_offset_x, ic1_seg_offset_y, i));
+	}
+
+	//flush last arc
+	arc_write(&s, us1_seg_in_arc, ff4_ellipse_foci);
+}
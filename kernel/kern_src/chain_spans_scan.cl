@@ -0,0 +1,30 @@
+// exclusive scan over the segment counts of every chain to find where each chain's segments go in the segment store
+// also clamps chains to fit in the store so later stages don't need to check capacity
+//NOTE: must be scheduled as 1D using EXACT rangeMode with param {1,1,1}
+//TODO: same as serial_reduce, this can be done with multiple threads by scanning chunks and then offsetting them
+#include "cast_helpers.cl"
+#include "seg_soa.cl"
+
+kernel void chain_spans_scan(
+	read_only image1d_t is2_start_coords,
+	read_only image1d_t us1_line_counts,
+	global uint2* ui2_chain_spans,
+	global uint* ui1_seg_total)
+{
+	if(get_global_id(0))	// only thread 0 proccesses anything here
+		return;
+
+	int max_index = get_image_width(is2_start_coords);
+	uint total = 0;
+	//for as many non-zero entries as is2_start_coords has
+	for(int i = 0; i < max_index && ((union l_conv)read_imagei(is2_start_coords, i).lo).l; ++i)
+	{
+		uint count = min(read_imageui(us1_line_counts, i).x, (uint)SEG_SOA_CAPACITY - total);
+		ui2_chain_spans[i] = (uint2)(total, count);
+		total += count;
+	}
+
+	if(total == SEG_SOA_CAPACITY)
+		printf("chain_spans_scan(): maxed out at %u\n", total);
+	ui1_seg_total[0] = total;
+}
@@ -0,0 +1,37 @@
+// compacts the sparse per pixel output of arc_builder into a short list of ellipse records so the host only
+// has to read back a few kilobytes instead of the whole ff4_ellipse_foci image
+// each record is 2 float4s: the absolute foci, then (edge distance, supporting segment count as uint bits, 0, 0)
+//NOTE: must be scheduled based on dims of us1_seg_in_arc
+//TODO: this could be folded into arc_builder's write out if list order stops mattering for anything downstream
+
+// max number of records, must match half the size of the list buffer in the manifest
+#ifndef ELLIPSE_LIST_CAPACITY
+#define ELLIPSE_LIST_CAPACITY	4096
+#endif//ELLIPSE_LIST_CAPACITY
+
+kernel void compact_ellipses(
+	read_only image2d_t us1_seg_in_arc,
+	read_only image2d_t ff4_ellipse_foci,
+	global uint* ui1_ellipse_cnt,
+	global float4* ff4_ellipse_list)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+
+	// arcs with less than 4 segments never got an ellipse fit
+	uint seg_cnt = read_imageui(us1_seg_in_arc, coords).x;
+	if(seg_cnt < 4)
+		return;
+
+	// count keeps going past capacity so the host can tell how many were dropped
+	uint index = atomic_inc(ui1_ellipse_cnt);
+	if(index >= ELLIPSE_LIST_CAPACITY)
+		return;
+
+	float4 foci = read_imagef(ff4_ellipse_foci, coords);
+	// arc base is on the ellipse so the sum of its distances to the foci is the edge distance
+	float2 base = convert_float2(coords);
+	float dist = fast_distance(base, foci.lo) + fast_distance(base, foci.hi);
+
+	ff4_ellipse_list[index * 2] = foci;
+	ff4_ellipse_list[index * 2 + 1] = (float4)(dist, as_float(seg_cnt), 0, 0);
+}
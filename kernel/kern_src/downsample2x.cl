@@ -0,0 +1,20 @@
+// builds the next level of an image pyramid by averaging 2x2 blocks,
+// size the output relative to the source with mode = 'DIVIDE_CEIL', params = [2,2,1]
+// [0] In	fu1_src: 1 channel greyscale (UNORM)
+// [1] Out	fu1_half: 1 channel greyscale (UNORM) at half the resolution
+kernel void downsample2x(
+	read_only image2d_t fu1_src,
+	write_only image2d_t fu1_half)
+{
+	// the last row/column of an odd sized source only has half a block, repeat the edge to fill it
+	const sampler_t samp = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	int2 src_coords = coords * 2;
+
+	float sum = read_imagef(fu1_src, samp, src_coords).x;
+	sum += read_imagef(fu1_src, samp, src_coords + (int2)(1, 0)).x;
+	sum += read_imagef(fu1_src, samp, src_coords + (int2)(0, 1)).x;
+	sum += read_imagef(fu1_src, samp, src_coords + 1).x;
+
+	write_imagef(fu1_half, coords, sum * 0.25f);
+}
@@ -0,0 +1,60 @@
+// variant of find_segment_starts.cl that reads the packed edge records written by link_edge_pixels_packed.cl,
+// the angle and the link bits of a pixel come from the same fetch so each pixel looked at is only read once
+#include "link_macros.cl"
+//FIXME: replace temp fix for multiple definition by adding proper support for included sources
+constant const int2 offsets_i_p[] = {(int2)(1,0),1,(int2)(0,1),(int2)(-1,1),(int2)(-1,0),-1,(int2)(0,-1),(int2)(1,-1)};
+
+// output is in the same 0bSE0lriii form as find_segment_starts.cl
+kernel void find_segment_starts_packed(
+	read_only image2d_t ic2_edge_rec,
+	write_only image2d_t uc1_starts_cont)
+{
+	const int2 coords = (int2)(get_global_id(0), get_global_id(1));
+
+	int2 rec = read_imagei(ic2_edge_rec, coords).lo;
+	uchar cont_data = EDGE_REC_CONT(rec);
+
+	int2 adjacent_rec;
+	uchar adjacent_data, adjacent_idx;
+	uchar is_end_adjacent = 0;	//also used for early rejection of unconnected 2-pixel segments
+
+	// y-junction prevention, stops multiple edges that would join to process a shared region
+	if(cont_data & HAS_R_CONT)	// if valid right continuation
+	{
+		adjacent_idx = cont_data & R_CONT_IDX_MASK;
+		adjacent_data = EDGE_REC_CONT(read_imagei(ic2_edge_rec, coords + offsets_i_p[adjacent_idx]).lo);
+		// right continuation's left continuation is not mutual, see find_segment_starts.cl
+		is_end_adjacent = (adjacent_data & (HAS_BOTH_CONT)) != HAS_BOTH_CONT || (((adjacent_data >> L_CONT_IDX_SHIFT) ^ adjacent_idx) != 4);
+	}
+
+	switch(cont_data & HAS_BOTH_CONT)
+	{
+	default:	// not an edge or a standard right end, vast majority exits here
+		return;
+	case HAS_BOTH_CONT:	// both sides have a continuation
+		adjacent_idx = cont_data >> L_CONT_IDX_SHIFT;
+		cont_data &= 0x1F;	// only right continuation and left support flag will ever be written to output regardless of path taken from this point
+		// the left neighbor's angle comes with its link bits so it's only fetched once
+		adjacent_rec = read_imagei(ic2_edge_rec, coords + offsets_i_p[adjacent_idx]).lo;
+		adjacent_data = EDGE_REC_CONT(adjacent_rec) & 0xF;
+		// a mutual left link is only a start if it qualifies as a loop breaking start
+		if((adjacent_data ^ adjacent_idx) == 0xC)
+		{
+			if(EDGE_REC_ANG(rec) < 0)	// to qualify for a loop breaking start, the grad angle must be non-negative
+				break;	//pass on only continuation data, no start flag
+
+			if(EDGE_REC_ANG(adjacent_rec) > 0)	// the gradient angle of the left neighbor must be negative
+				break;	//pass on only continuation data, no start flag
+		}
+		// fall-through to add start flag
+	case HAS_R_CONT:
+		// if it starts and ends on the same pixel or an adjacent pixel,
+		// it's not usable data and shouldn't be marked as a start
+		if(is_end_adjacent)
+			break;
+
+		cont_data |= IS_START;
+	}
+
+	write_imageui(uc1_starts_cont, coords, cont_data | (is_end_adjacent << END_ADJ_SHIFT));
+}
@@ -0,0 +1,27 @@
+// first pass of duplicate ellipse merging, inserts every candidate of the list into the spatial hash in ellipse_hash.cl
+//NOTE: must be scheduled as ELLIPSE_LIST_CAPACITY work items, ui1_buckets must be zeroed before each run
+#include "ellipse_hash.cl"
+
+// [0] In	ui1_ellipse_cnt: candidate count, may be past capacity
+// [1] In	ff4_ellipse_list: candidate records, see compact_ellipses.cl
+// [2] Out	ui1_buckets: how many candidates landed in each bucket, keeps counting past ELLIPSE_HASH_SLOTS
+// [3] Out	ui1_bucket_items: ELLIPSE_HASH_SLOTS list indices per bucket
+kernel void hash_ellipses(
+	global const uint* ui1_ellipse_cnt,
+	global const float4* ff4_ellipse_list,
+	global uint* ui1_buckets,
+	global uint* ui1_bucket_items)
+{
+	uint index = get_global_id(0);
+	if(index >= min(*ui1_ellipse_cnt, (uint)ELLIPSE_LIST_CAPACITY))
+		return;
+
+	float4 foci = ff4_ellipse_list[index * 2];
+	float dist = ff4_ellipse_list[index * 2 + 1].x;
+	uint bucket = ellipse_hash_bucket(ellipse_hash_cell(foci, dist));
+
+	// overflowing candidates can still find their duplicates but can't be found by them, so a full bucket at worst lets a duplicate through
+	uint slot = atomic_inc(&ui1_buckets[bucket]);
+	if(slot < ELLIPSE_HASH_SLOTS)
+		ui1_bucket_items[bucket * ELLIPSE_HASH_SLOTS + slot] = index;
+}
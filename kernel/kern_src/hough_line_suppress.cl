@@ -0,0 +1,43 @@
+// removes edge pixels that lie on long straight lines before linking so that arc_builder doesn't spend its time
+// walking segment chains that can never fit an ellipse, runs after hough_lines_local has filled the accumulator
+#include "hough_common.cl"
+
+// votes a bin needs before the pixels in it count as part of a straight line, roughly the line's length in pixels
+#ifndef HOUGH_LINE_THRESH
+#define HOUGH_LINE_THRESH	96
+#endif//HOUGH_LINE_THRESH
+
+// [0] In	ic1_grad_ang: 1 channel signed 7-bit angle with 1 bit occupancy flag from non_max_sup
+// [1] In	ui1_hough_acc: accumulator filled by hough_lines_local
+// [2] Out	ic1_curved_ang: copy of ic1_grad_ang without the straight line pixels, must be cleared before each run
+kernel void hough_line_suppress(
+	read_only image2d_t ic1_grad_ang,
+	global const uint* ui1_hough_acc,
+	write_only image2d_t ic1_curved_ang)
+{
+	const int2 coords = (int2)(get_global_id(0), get_global_id(1));
+
+	char grad_ang = read_imagei(ic1_grad_ang, coords).x;
+	if(!grad_ang)
+		return;
+
+	const int2 dims = get_image_dim(ic1_grad_ang);
+	const int rho_res = hough_rho_res(dims);
+	float2 p = convert_float2(coords - dims / 2);
+
+	// check the same bins this pixel voted for, whichever is strongest is the line it most likely belongs to
+	int theta = hough_theta_bin(grad_ang);
+	uint votes = 0;
+	for(int d = -HOUGH_SPREAD; d <= HOUGH_SPREAD; ++d)
+	{
+		int t = (theta + d) & (ANGLE_RES - 1);
+		int rho = hough_rho_bin(p, hough_normal(t), rho_res);
+		if(0 <= rho && rho < rho_res)
+			votes = max(votes, ui1_hough_acc[t * rho_res + rho]);
+	}
+
+	//TODO: bins are global so collinear but separate short edges can add up past the threshold, checking the
+	// pixel's neighbors along the line direction would tell real lines apart from coincidences
+	if(votes < HOUGH_LINE_THRESH)
+		write_imagei(ic1_curved_ang, coords, grad_ang);
+}
@@ -0,0 +1,76 @@
+// edge pixel driven replacement for unused/hough_lines.cl, each work group votes its tile of edge pixels into a
+// local memory histogram and then merges it into the global accumulator with one atomic per non-zero bin, so
+// global atomic traffic scales with the number of distinct lines crossing a tile instead of the number of edge pixels
+#include "samplers.cl"
+#include "hough_common.cl"
+
+// rho bins kept per angle in the local histogram, a tile only spans at most its width + height in rho so this
+// covers work groups up to 16x16 without spilling, votes that land outside it go straight to the global accumulator
+#ifndef HOUGH_LOCAL_RHO
+#define HOUGH_LOCAL_RHO		34
+#endif//HOUGH_LOCAL_RHO
+#define HOUGH_LOCAL_LEN		(ANGLE_RES * HOUGH_LOCAL_RHO)
+
+// lowest rho bin any pixel of the work group's tile can land in for theta bin t, every work item computes
+// the same value so the vote and merge passes agree on where the local histogram starts
+inline int tile_rho_base(float2 tile_origin, int2 tile_size, int t, int rho_res)
+{
+	float2 n = hough_normal(t);
+	// the corner furthest against the normal
+	float2 corner = (float2)(n.x < 0 ? tile_size.x - 1 : 0, n.y < 0 ? tile_size.y - 1 : 0);
+	return hough_rho_bin(tile_origin + corner, n, rho_res);
+}
+
+// [0] In	ic1_grad_ang: 1 channel signed 7-bit angle with 1 bit occupancy flag from non_max_sup
+// [1] Out	ui1_hough_acc: [ANGLE_RES][rho_res] vote counts, see hough_common.cl, must be cleared before each run
+//NOTE: the range may be any size and shape, no reqd_work_group_size since stages are enqueued without a local size
+kernel void hough_lines_local(read_only image2d_t ic1_grad_ang, global uint* ui1_hough_acc)
+{
+	local uint hist[HOUGH_LOCAL_LEN];
+
+	const int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	const int2 tile_size = (int2)(get_local_size(0), get_local_size(1));
+	const int lid = get_local_id(1) * tile_size.x + get_local_id(0);
+	const int group_len = tile_size.x * tile_size.y;
+
+	for(int i = lid; i < HOUGH_LOCAL_LEN; i += group_len)
+		hist[i] = 0;
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	const int2 dims = get_image_dim(ic1_grad_ang);
+	const int rho_res = hough_rho_res(dims);
+	const float2 center = convert_float2(dims / 2);
+	const float2 tile_origin = convert_float2(coords - (int2)(get_local_id(0), get_local_id(1))) - center;
+
+	// clamped sampler so work items past the edge of a non-uniform range read 0 and don't vote
+	char grad_ang = read_imagei(ic1_grad_ang, clamped, coords).x;
+	if(grad_ang)
+	{
+		float2 p = convert_float2(coords) - center;
+		int theta = hough_theta_bin(grad_ang);
+		for(int d = -HOUGH_SPREAD; d <= HOUGH_SPREAD; ++d)
+		{
+			// wrapping past 0 or 180 degrees flips the normal, using the normal of the wrapped bin flips rho to match
+			int t = (theta + d) & (ANGLE_RES - 1);
+			int rho = hough_rho_bin(p, hough_normal(t), rho_res);
+			int local_idx = rho - tile_rho_base(tile_origin, tile_size, t, rho_res);
+			if(0 <= local_idx && local_idx < HOUGH_LOCAL_RHO)
+				atomic_inc(hist + t * HOUGH_LOCAL_RHO + local_idx);
+			else if(0 <= rho && rho < rho_res)
+				atomic_inc(ui1_hough_acc + t * rho_res + rho);
+		}
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	// merge, consecutive work items take consecutive rho bins of the same angle so the base is mostly shared
+	for(int i = lid; i < HOUGH_LOCAL_LEN; i += group_len)
+	{
+		uint votes = hist[i];
+		if(!votes)
+			continue;
+		int t = i / HOUGH_LOCAL_RHO;
+		int rho = tile_rho_base(tile_origin, tile_size, t, rho_res) + i % HOUGH_LOCAL_RHO;
+		if(0 <= rho && rho < rho_res)
+			atomic_add(ui1_hough_acc + t * rho_res + rho, votes);
+	}
+}
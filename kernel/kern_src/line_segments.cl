@@ -11,15 +11,17 @@
 kernel void line_segments(
 	read_only image2d_t uc1_cont_info,
 	read_only image1d_t is2_start_coords,
+	global uint const* ui1_start_cnt,
 	write_only image2d_t ic2_line_data,
 	write_only image1d_t us1_line_counts)
 {
-	short index = get_global_id(0);	// must be scheduled as 1D
+	uint index = get_global_id(0);	// must be scheduled as 1D
+	// the range is only rounded up to the count from serial_reduce so anything past it was never written this frame
+	if(index >= *ui1_start_cnt)
+		return;
 	
 	// initialize variables of line segment tracing loop for first iteration
 	int2 coords = read_imagei(is2_start_coords, index).lo;	// current pixel coordinates
-	if(!((union l_conv)coords).l)	// this does mean a start at (0,0) won't get processed but I don't think that's particularly likely to happen and be critical
-		return;
 	
 	uchar cont_data, cont_idx, /*is_supported,*/ to_end = 0;
 	cont_data = read_imageui(uc1_cont_info, coords).x;
@@ -0,0 +1,99 @@
+#include "cast_helpers.cl"
+#include "offsets_LUT.cl"
+#include "math_helpers.cl"
+#include "link_macros.cl"
+// persistent threads variant of line_segments, a fixed number of work items are launched that each keep pulling
+// the next unprocessed start off of a shared counter as soon as they finish their current chain. The nested
+// segment/pixel loops are flattened so that each loop iteration advances every work item by exactly 1 pixel,
+// this keeps the lanes of a SIMD group converged instead of waiting on whichever lane got the longest chain
+//NOTE: must be scheduled as 1D with a fixed range of roughly the number of work items the device can keep resident,
+// ui1_work_head must be zeroed before each run (is_cleared in the manifest)
+//NOTE: output is identical to line_segments, see there for details on the segment criteria
+
+kernel void line_segments_pt(
+	read_only image2d_t uc1_cont_info,
+	read_only image1d_t is2_start_coords,
+	global uint* ui1_work_head,
+	write_only image2d_t ic2_line_data,
+	write_only image1d_t us1_line_counts)
+{
+	uint max_index = get_image_width(is2_start_coords);
+	uint index;
+
+	uchar cont_data, cont_idx, to_end;
+	uchar path_hist[32];
+	char2 offset_x2_mid, offset_end;
+	int2 coords, base_coords;
+	ushort seg_count;
+	int len = 0;	// 0 is used to signal that the current chain is finished and a new one must be pulled
+
+	for(;;)
+	{
+		if(!len)
+		{
+			index = atomic_inc(ui1_work_head);
+			if(index >= max_index)
+				break;
+
+			coords = read_imagei(is2_start_coords, index).lo;
+			// start list is compacted by serial_reduce so the first empty entry means there's nothing left to pull
+			if(!((union l_conv)coords).l)
+				break;
+
+			// start specified in start_info implicitly has a valid continuation, so can be safely masked to just index
+			cont_idx = read_imageui(uc1_cont_info, coords).x & R_CONT_IDX_MASK;
+			base_coords = coords;
+			coords += offsets[cont_idx];
+			offset_x2_mid = offset_end = offsets_c[cont_idx];
+			path_hist[0] = cont_idx;
+			seg_count = 1;
+			to_end = 0;
+			len = 1;
+		}
+
+		cont_data = read_imageui(uc1_cont_info, coords).x;
+		cont_idx = cont_data & R_CONT_IDX_MASK;
+		offset_end += offsets_c[cont_idx];
+
+		//check that data wasn't a start OR an end was signalled last pixel
+		to_end |= cont_data & IS_START;
+		uchar is_seg_done = to_end;
+		if(!is_seg_done)
+		{
+			to_end = cont_data & IS_END_ADJ;
+
+			coords += offsets[cont_idx];
+			offset_x2_mid += offsets_c[path_hist[(len >> 1) & 0x1F]];
+			// if 2* the midpoint is further than 1 pixel from the endpoint OR length exceed maximum allowed
+			is_seg_done = mag2_2d_c(offset_end - offset_x2_mid) > 4 || len >= 127;
+
+			//addition to offset_mid delayed to keep narrower distance threshold range, may or may not be ideal solution
+			if(!is_seg_done && len < 64)
+				path_hist[len & 0x1F] = cont_idx;
+			++len;
+		}
+
+		if(!is_seg_done)
+			continue;
+
+		// wind back 1 pixel to last position where it was any of the following
+		// depending on which exit condition occured:
+		// 2*midpoint within 1 pixel of endpoint / within max length / didn't overrun a start or end
+		offset_end -= offsets_c[cont_idx];
+		write_imagei(ic2_line_data, base_coords, (int4)(convert_int2(offset_end), 0, -1));
+
+		if(to_end)
+		{
+			write_imageui(us1_line_counts, index, seg_count);
+			len = 0;
+			continue;
+		}
+
+		// start the next segment of the same chain from the pixel that ended the last one
+		base_coords += convert_int2(offset_end);
+		offset_x2_mid = offset_end = offsets_c[cont_idx];
+		path_hist[0] = cont_idx;
+		++seg_count;
+		len = 1;
+	}
+}
@@ -0,0 +1,32 @@
+// copies the segments of each chain traced by line_segments into the structure of arrays segment store so that
+// later stages can stream through them in order instead of following them through the image one dependent read at a time
+//NOTE: must be scheduled based on dims of is2_start_coords
+#include "cast_helpers.cl"
+#include "seg_soa.cl"
+
+kernel void line_segments_soa(
+	read_only image1d_t is2_start_coords,
+	read_only image2d_t ic2_line_data,
+	global const uint2* ui2_chain_spans,
+	global short* is1_seg_start_x,
+	global short* is1_seg_start_y,
+	global char* ic1_seg_offset_x,
+	global char* ic1_seg_offset_y)
+{
+	int index = get_global_id(0);	// must be scheduled as 1D
+
+	int2 coords = read_imagei(is2_start_coords, index).lo;
+	if(!((union l_conv)coords).l)
+		return;
+
+	uint2 span = ui2_chain_spans[index];
+	for(uint i = span.x; i < span.x + span.y; ++i)
+	{
+		int2 offset = read_imagei(ic2_line_data, coords).lo;
+		is1_seg_start_x[i] = coords.x;
+		is1_seg_start_y[i] = coords.y;
+		ic1_seg_offset_x[i] = offset.x;
+		ic1_seg_offset_y[i] = offset.y;
+		coords += offset;
+	}
+}
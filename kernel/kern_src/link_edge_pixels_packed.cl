@@ -0,0 +1,19 @@
+#include "edge_link.cl"
+
+// same linking as link_edge_pixels.cl but writes the angle and the link bits together as a packed edge record
+// (see link_macros.cl) so find_segment_starts_packed.cl only needs 1 fetch per pixel it looks at
+__kernel void link_edge_pixels_packed(
+	read_only image2d_t ic1_grad_ang,
+	write_only image2d_t ic2_edge_rec)
+{
+	const int2 coords = (int2)(get_global_id(0), get_global_id(1));
+
+	char grad_ang = read_imagei(ic1_grad_ang, coords).x;
+	// not an edge, vast majority exits here
+	if(!grad_ang)
+		return;
+
+	// the angle is kept even if the pixel doesn't get linked since the occupancy flag is part of it
+	uchar cont_data = link_edge_pixel(ic1_grad_ang, coords, grad_ang);
+	write_imagei(ic2_edge_rec, coords, (int4)(grad_ang, (char)cont_data, 0, 0));
+}
@@ -0,0 +1,87 @@
+// second pass of duplicate ellipse merging, every candidate searches its own and the adjacent hash cells for duplicates,
+// only the one with the most supporting segments (lowest index on ties) of each group writes a record, averaged over
+// the whole group weighted by supporting segment count
+//NOTE: a candidate that matches any stronger candidate never writes, so in a chain A > B > C where C only matches B,
+// B and C are both dropped and only A's record is written, which doesn't include C in its average since C doesn't match A,
+// arcs of the same ellipse should all be within tolerance of its best fit anyway
+//NOTE: must be scheduled as ELLIPSE_LIST_CAPACITY work items after hash_ellipses
+#include "ellipse_hash.cl"
+
+// [0] In	ui1_ellipse_cnt: candidate count, may be past capacity
+// [1] In	ff4_ellipse_list: candidate records, see compact_ellipses.cl
+// [2] In	ui1_buckets: per bucket counts from hash_ellipses
+// [3] In	ui1_bucket_items: per bucket list indices from hash_ellipses
+// [4] Out	ui1_merged_cnt: number of merged records, must be cleared before each run
+// [5] Out	ff4_merged_list: one record per ellipse in the same layout as the input, seg_cnt is the total of the group
+kernel void merge_ellipses(
+	global const uint* ui1_ellipse_cnt,
+	global const float4* ff4_ellipse_list,
+	global const uint* ui1_buckets,
+	global const uint* ui1_bucket_items,
+	global uint* ui1_merged_cnt,
+	global float4* ff4_merged_list)
+{
+	uint index = get_global_id(0);
+	if(index >= min(*ui1_ellipse_cnt, (uint)ELLIPSE_LIST_CAPACITY))
+		return;
+
+	float4 foci = ff4_ellipse_list[index * 2];
+	float4 info = ff4_ellipse_list[index * 2 + 1];
+	uint seg_cnt = as_uint(info.y);
+	int3 cell = ellipse_hash_cell(foci, info.x);
+
+	// sums weighted by supporting segments, the candidate itself included
+	float4 foci_sum = foci * seg_cnt;
+	float dist_sum = info.x * seg_cnt;
+	float support_sum = info.z * seg_cnt;
+	uint weight = seg_cnt;
+
+	// adjacent cells can hash to the same bucket, each bucket must only be counted once
+	uint visited[27];
+	int visited_cnt = 0;
+	for(int dz = -1; dz <= 1; ++dz)
+	for(int dy = -1; dy <= 1; ++dy)
+	for(int dx = -1; dx <= 1; ++dx)
+	{
+		uint bucket = ellipse_hash_bucket(cell + (int3)(dx, dy, dz));
+		int v = 0;
+		while(v < visited_cnt && visited[v] != bucket)
+			++v;
+		if(v < visited_cnt)
+			continue;
+		visited[visited_cnt++] = bucket;
+
+		uint item_cnt = min(ui1_buckets[bucket], (uint)ELLIPSE_HASH_SLOTS);
+		global const uint* items = ui1_bucket_items + bucket * ELLIPSE_HASH_SLOTS;
+		for(uint i = 0; i < item_cnt; ++i)
+		{
+			uint other = items[i];
+			if(other == index)
+				continue;
+			float4 other_foci = ff4_ellipse_list[other * 2];
+			float4 other_info = ff4_ellipse_list[other * 2 + 1];
+			char match = ellipse_match(foci, info.x, other_foci, other_info.x);
+			if(!match)
+				continue;
+
+			// a stronger duplicate exists so it writes the record for this group instead
+			uint other_seg_cnt = as_uint(other_info.y);
+			if(other_seg_cnt > seg_cnt || (other_seg_cnt == seg_cnt && other < index))
+				return;
+
+			if(match < 0)
+				other_foci = other_foci.zwxy;
+			foci_sum += other_foci * other_seg_cnt;
+			dist_sum += other_info.x * other_seg_cnt;
+			support_sum += other_info.z * other_seg_cnt;
+			weight += other_seg_cnt;
+		}
+	}
+
+	uint out_idx = atomic_inc(ui1_merged_cnt);
+	if(out_idx >= ELLIPSE_LIST_CAPACITY)
+		return;
+
+	ff4_merged_list[out_idx * 2] = foci_sum / weight;
+	ff4_merged_list[out_idx * 2 + 1] = (float4)(dist_sum / weight, as_float(weight), support_sum / weight, 0);
+}
@@ -0,0 +1,60 @@
+// packs an image into tightly packed 8-bit channels so the host can save it without converting it pixel by pixel,
+// not a manifest stage, the host builds it per output image with defines generated from the image's cl_image_format
+// PACK_MODE	how read values are turned into bytes, one of the PACK_* modes below
+// CHANNEL_CNT	how many channels to write per pixel, 1 thru 4
+// SHIFT		for integer modes, how far right to shift to keep the most significant byte
+// SWIZZLE		which components of the read value to pack, ie. wyzw so alpha only images pack their alpha
+#define PACK_UNORM	0	// scaled to the full byte range
+#define PACK_SNORM	1	// offset so that 0 is mid gray
+#define PACK_UINT	2	// keeps the most significant byte
+#define PACK_INT	3	// keeps the most significant byte, offset so that 0 is mid gray
+#define PACK_FLOAT	4	// most significant byte of the bit pattern, reordered so sign and exponent sort logically
+#define PACK_HALF	5	// same as PACK_FLOAT but for the half bit pattern
+
+#ifndef SWIZZLE
+#define SWIZZLE xyzw
+#endif
+
+// signed most significant bytes become negative values mirrored below 0x80 and positive ones above it
+inline uchar4 order_sign_exponent(char4 top)
+{
+	return select(as_uchar4(top) | (uchar4)0x80, as_uchar4(-top), top);
+}
+
+kernel void pack_uchar(read_only image2d_t src, global uchar* uc1_packed)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+	uchar4 out;
+
+#if PACK_MODE == PACK_UINT
+	uint4 val = read_imageui(src, coords).SWIZZLE;
+	out = convert_uchar4(val >> SHIFT);
+#elif PACK_MODE == PACK_INT
+	int4 val = read_imagei(src, coords).SWIZZLE;
+	out = as_uchar4(convert_char4(val >> SHIFT)) ^ (uchar4)0x80;
+#else
+	float4 val = read_imagef(src, coords).SWIZZLE;
+#if PACK_MODE == PACK_UNORM
+	out = convert_uchar4_sat_rte(val * 255);
+#elif PACK_MODE == PACK_SNORM
+	out = convert_uchar4_sat_rte(val * 127 + 128);
+#elif PACK_MODE == PACK_FLOAT
+	out = order_sign_exponent(convert_char4(as_int4(val) >> 24));
+#elif PACK_MODE == PACK_HALF
+	ushort4 bits;
+	vstore_half4(val, 0, (private half*)&bits);
+	out = order_sign_exponent(convert_char4(as_short4(bits) >> 8));
+#endif
+#endif
+
+	global uchar* dst = uc1_packed + ((size_t)coords.y * get_image_width(src) + coords.x) * CHANNEL_CNT;
+#if CHANNEL_CNT == 1
+	dst[0] = out.x;
+#elif CHANNEL_CNT == 2
+	vstore2(out.xy, 0, dst);
+#elif CHANNEL_CNT == 3
+	vstore3(out.xyz, 0, dst);
+#else
+	vstore4(out, 0, dst);
+#endif
+}
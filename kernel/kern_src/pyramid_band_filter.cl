@@ -0,0 +1,47 @@
+// coarse-to-fine refinement for pyramid mode, keeps only the full resolution edge pixels that lie in a narrow band
+// around an ellipse found by compact_ellipses at a coarse pyramid level, so the full resolution linking and tracing
+// stages only follow edges that can refine a coarse candidate instead of every edge in the frame
+// the scale between levels comes from the image sizes so any DIVIDE_CEIL sized level works
+//NOTE: must be scheduled based on dims of ic1_grad_ang, ic1_band_ang should be cleared since pixels outside bands aren't written
+
+// max number of records in the coarse list, must match compact_ellipses.cl
+#ifndef ELLIPSE_LIST_CAPACITY
+#define ELLIPSE_LIST_CAPACITY	4096
+#endif//ELLIPSE_LIST_CAPACITY
+
+// how far the sum of the distances to both foci may deviate from the edge distance, in full resolution pixels,
+// roughly twice the band's half width along the minor axis
+#ifndef PYRAMID_BAND
+#define PYRAMID_BAND	6.0f
+#endif//PYRAMID_BAND
+
+kernel void pyramid_band_filter(
+	read_only image2d_t ic1_grad_ang,
+	read_only image2d_t ic1_coarse_ang,	// only used for its size to get the scale between levels
+	global const uint* ui1_coarse_cnt,
+	global const float4* ff4_coarse_list,
+	write_only image2d_t ic1_band_ang)
+{
+	int2 coords = (int2)(get_global_id(0), get_global_id(1));
+
+	char grad_ang = read_imagei(ic1_grad_ang, coords).x;
+	// not an edge, vast majority exits here
+	if(!grad_ang)
+		return;
+
+	float2 scale = convert_float2(get_image_dim(ic1_grad_ang)) / convert_float2(get_image_dim(ic1_coarse_ang));
+	float4 scale4 = (float4)(scale, scale);
+	// both levels are compared by pixel centers so scaling doesn't shift coarse positions by half a coarse pixel
+	float2 point = convert_float2(coords) + 0.5f;
+	uint cnt = min(*ui1_coarse_cnt, (uint)ELLIPSE_LIST_CAPACITY);
+	for(uint i = 0; i < cnt; ++i)
+	{
+		float4 foci = (ff4_coarse_list[i * 2] + 0.5f) * scale4;
+		float dist = ff4_coarse_list[i * 2 + 1].x * scale.x;
+		if(fabs(dist - (fast_distance(point, foci.lo) + fast_distance(point, foci.hi))) < PYRAMID_BAND)
+		{
+			write_imagei(ic1_band_ang, coords, grad_ang);
+			return;
+		}
+	}
+}
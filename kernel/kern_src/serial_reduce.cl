@@ -1,10 +1,12 @@
 // reduce very sparse 2D info to compact 1D
 // This might get replaced with a simple hash and retry on collision method later so that it's not a serial bottleneck
 //NOTE: must be scheduled as 1D using EXACT rangeMode with param {1,1,1}
+// the number of starts written goes to ui1_start_cnt so later stages can use it as their range's count_arg
 
 __kernel void serial_reduce(
 	read_only image2d_t uc1_starts_cont,
-	write_only image1d_t is2_start_coords)
+	write_only image1d_t is2_start_coords,
+	global uint* ui1_start_cnt)
 {
 	ushort max_size = get_image_width(is2_start_coords);	//TODO: this can probably be replaced optionally with a define
 	if(get_global_id(0))	// only thread 0 proccesses anything here
@@ -25,10 +27,12 @@ __kernel void serial_reduce(
 				if(index == max_size)	// prevent possibly attempting to write past the end of the image, which can freeze the pipeline
 				{
 					printf("serial_reduce(): maxed out at %u\n", index);
+					*ui1_start_cnt = index;
 					return;
 				}
 			}
 		}
 	}
 	printf("serial_reduce(): max index was %u\n", index);
+	*ui1_start_cnt = index;
 }
\ No newline at end of file
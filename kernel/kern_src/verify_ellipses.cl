@@ -0,0 +1,136 @@
+// scores each candidate from compact_ellipses by how much of its perimeter is actually backed by edge pixels,
+// arc_builder accepts a fit from as few as 4 or 5 points so without this most false positives only get rejected on the host
+// one work group per candidate, each work item walks its share of evenly spaced perimeter samples and looks for an
+// edge pixel close to each one with a gradient angle matching the ellipse normal there
+//NOTE: must be scheduled as (VERIFY_GROUP_SIZE, ELLIPSE_LIST_CAPACITY), groups past the candidate count exit immediately
+#include "samplers.cl"
+
+#ifndef ELLIPSE_LIST_CAPACITY
+#define ELLIPSE_LIST_CAPACITY	4096
+#endif//ELLIPSE_LIST_CAPACITY
+// must match range param[0] in the manifest
+#ifndef VERIFY_GROUP_SIZE
+#define VERIFY_GROUP_SIZE		64
+#endif//VERIFY_GROUP_SIZE
+// spacing in pixels between perimeter samples, and the cap on samples so huge candidates don't stall their group
+#ifndef VERIFY_SPACING
+#define VERIFY_SPACING			2.0f
+#endif//VERIFY_SPACING
+#ifndef VERIFY_MAX_SAMPLES
+#define VERIFY_MAX_SAMPLES		1024
+#endif//VERIFY_MAX_SAMPLES
+// max difference between edge and ellipse normal angles in grad_ang units (256 per turn), polarity is ignored
+#ifndef VERIFY_ANGLE_TOL
+#define VERIFY_ANGLE_TOL		12
+#endif//VERIFY_ANGLE_TOL
+// fraction of in bounds samples that need support for a candidate to be kept
+#ifndef VERIFY_MIN_SUPPORT
+#define VERIFY_MIN_SUPPORT		0.5f
+#endif//VERIFY_MIN_SUPPORT
+
+// checks the 3x3 neighborhood of the sample for an edge pixel whose angle matches the normal angle, non_max_sup
+// thins edges to 1 pixel so anything further away than that is a different edge
+inline char has_edge_support(read_only image2d_t ic1_grad_ang, int2 coords, char normal_ang)
+{
+	for(int dy = -1; dy <= 1; ++dy)
+	{
+		for(int dx = -1; dx <= 1; ++dx)
+		{
+			char grad_ang = read_imagei(ic1_grad_ang, clamped, coords + (int2)(dx, dy)).x;
+			// doubling the difference wraps anti-aligned angles to near 0 as well, same trick as unused/hough_lines.cl
+			if(grad_ang && abs((char)((grad_ang - normal_ang) << 1)) < 2 * VERIFY_ANGLE_TOL)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+// [0] In	ic1_grad_ang: edge image the candidates were found in
+// [1] In	ui1_ellipse_cnt: candidate count written by compact_ellipses, may be past capacity
+// [2] In	ff4_ellipse_list: candidate records, see compact_ellipses.cl
+// [3] Out	ui1_verified_cnt: number of records that passed, must be cleared before each run
+// [4] Out	ff4_verified_list: records that passed, same layout as the input with the support ratio in .z of the 2nd float4
+__attribute__((reqd_work_group_size(VERIFY_GROUP_SIZE, 1, 1)))
+kernel void verify_ellipses(
+	read_only image2d_t ic1_grad_ang,
+	global const uint* ui1_ellipse_cnt,
+	global const float4* ff4_ellipse_list,
+	global uint* ui1_verified_cnt,
+	global float4* ff4_verified_list)
+{
+	local uint hits, visible;
+
+	// whole group takes the same branch so returning before the barrier is fine
+	const uint index = get_group_id(1);
+	if(index >= min(*ui1_ellipse_cnt, (uint)ELLIPSE_LIST_CAPACITY))
+		return;
+
+	const float4 foci = ff4_ellipse_list[index * 2];
+	const float4 info = ff4_ellipse_list[index * 2 + 1];
+
+	// semi axes from the foci and edge distance, candidates whose foci are further apart than the edge distance
+	// are degenerate fits that can't be sampled and get dropped by leaving b as NaN
+	float2 axis = foci.hi - foci.lo;
+	float c = length(axis) / 2;
+	float a = info.x / 2;
+	float b = sqrt(a * a - c * c);
+	if(!(b > 0.5f))
+		return;
+
+	const float2 center = (foci.lo + foci.hi) / 2;
+	const float2 u = c > 0 ? axis / (2 * c) : (float2)(1, 0);
+	const float2 v = (float2)(-u.y, u.x);
+	const int2 dims = get_image_dim(ic1_grad_ang);
+
+	// Ramanujan's approximation of the perimeter
+	float perimeter = M_PI_F * (3 * (a + b) - sqrt((3 * a + b) * (a + 3 * b)));
+	int sample_cnt = clamp((int)(perimeter / VERIFY_SPACING), VERIFY_GROUP_SIZE, VERIFY_MAX_SAMPLES);
+	float step = 2 * M_PI_F / sample_cnt;
+
+	const int lid = get_local_id(0);
+	if(lid == 0)
+	{
+		hits = 0;
+		visible = 0;
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	uint my_hits = 0, my_visible = 0;
+	for(int i = lid; i < sample_cnt; i += VERIFY_GROUP_SIZE)
+	{
+		float cos_t;
+		float sin_t = sincos(i * step, &cos_t);
+		float2 p = center + a * cos_t * u + b * sin_t * v;
+		int2 coords = convert_int2_rte(p);
+		// only the part of the ellipse that's in frame can be judged
+		if(any(coords < 0) || any(coords >= dims))
+			continue;
+		++my_visible;
+
+		// normal is the gradient of the summed focal distances, the bisector of the directions away from each focus
+		float2 n = fast_normalize(p - foci.lo) + fast_normalize(p - foci.hi);
+		char normal_ang = convert_char_sat_rte(atan2pi(n.y, n.x) * 128);
+		my_hits += has_edge_support(ic1_grad_ang, coords, normal_ang);
+	}
+	if(my_visible)
+	{
+		atomic_add(&visible, my_visible);
+		atomic_add(&hits, my_hits);
+	}
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	if(lid)
+		return;
+
+	// mostly out of frame candidates don't have enough samples left to be judged fairly
+	float support = (float)hits / visible;
+	if(visible < VERIFY_GROUP_SIZE / 4 || support < VERIFY_MIN_SUPPORT)
+		return;
+
+	uint out_idx = atomic_inc(ui1_verified_cnt);
+	if(out_idx >= ELLIPSE_LIST_CAPACITY)
+		return;
+
+	ff4_verified_list[out_idx * 2] = foci;
+	ff4_verified_list[out_idx * 2 + 1] = (float4)(info.x, info.y, support, 0);
+}
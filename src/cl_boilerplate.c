@@ -2,8 +2,11 @@
 #include "clbp_utils.h"
 #include "cl_error_handlers.h"
 #include "stb_image.h"
+#include "thread_pool.h"
 
 #define CLBP_MEM_RW	(CL_MEM_READ_ONLY | CL_MEM_WRITE_ONLY)
+// first line of arg access cache files, bump the version if the line format changes
+#define ARG_CACHE_HEADER	"clbp_arg_access 1"
 
 // attempts to get the first available GPU or if none available CPU
 //TODO: actually implement multiple attempts to find a GPU, currently just takes the first device of the first platform
@@ -84,21 +87,44 @@ cl_int allocStagedQArrays(QStaging const* staging, StagedQ* staged)
 	staged->img_arg_cnt = staging->img_arg_cnt;
 	staged->stage_cnt = staging->stage_cnt;
 
-	size_t size3d_byte_cnt = (staged->img_arg_cnt + staged->stage_cnt) * sizeof(Size3D);
+	size_t size3d_byte_cnt = (staged->img_arg_cnt + 2 * staged->stage_cnt) * sizeof(Size3D);
 	staged->img_sizes = malloc(size3d_byte_cnt);
 	staged->ranges = staged->img_sizes + staged->img_arg_cnt;
+	staged->local_ranges = staged->ranges + staged->stage_cnt;
 
-	size_t cl_ptr_byte_cnt = (staged->img_arg_cnt + staging->kernel_cnt) * sizeof(cl_mem);
-	staged->img_args = malloc(cl_ptr_byte_cnt);
+	// one kernel instance per stage, stages can share a kernel program so kernel_cnt isn't enough,
+	// zeroed so that a partially instantiated queue can still be released
+	staged->img_args = calloc(staged->img_arg_cnt + staged->stage_cnt, sizeof(cl_mem));
 	staged->kernels = (cl_kernel*)staged->img_args + staged->img_arg_cnt;
 
+	staged->arg_host_flags = calloc(staged->img_arg_cnt, sizeof(uint8_t));
+	staged->readback_periods = calloc(staged->img_arg_cnt, sizeof(uint16_t));
+	staged->stage_host_flags = calloc(staged->stage_cnt, sizeof(uint8_t));
+	staged->sample_periods = malloc(staged->stage_cnt * sizeof(uint16_t));
+	staged->count_args = malloc(staged->stage_cnt * sizeof(uint16_t));
+
 	// check for failed allocation and free if it was partially allocated
-	if(!staged->img_sizes || !staged->img_args)
+	if(!staged->img_sizes || !staged->img_args || !staged->arg_host_flags || !staged->readback_periods
+		|| !staged->stage_host_flags || !staged->sample_periods || !staged->count_args)
 	{
 		free(staged->img_sizes);
 		free(staged->img_args);
+		free(staged->arg_host_flags);
+		free(staged->readback_periods);
+		free(staged->stage_host_flags);
+		free(staged->sample_periods);
+		free(staged->count_args);
 		return CLBP_OUT_OF_MEMORY;
 	}
+
+	// sampled stages stay skipped until scheduleSampledStages() picks a frame for them
+	for(int i = 0; i < staged->stage_cnt; ++i)
+	{
+		staged->count_args[i] = staging->kern_stg[i].count_idx;
+		staged->sample_periods[i] = staging->kern_stg[i].sample_period;
+		if(staged->sample_periods[i] != 1)
+			staged->stage_host_flags[i] = CLBP_SHF_SKIP;
+	}
 	return CLBP_OK;
 }
 
@@ -120,72 +146,234 @@ void calcRanges(QStaging const* staging, StagedQ* staged, clbp_Error* e)
 	puts("Done.");
 }
 
-// handles using staging data to selectively open kernel program source files and compile and link them into a single program binary
+// prints the bytes each arg needs, the total, and every stage's NDRange, then checks them against the device's memory limits,
+// meant to be run after calcRanges() so oversized configurations are caught before anything gets allocated
+//NOTE: sizes are tightly packed so implementations that pad image rows will use somewhat more than reported,
+// and the packed readback buffers made after this aren't counted
+void planDeviceMemory(cl_device_id device, QStaging const* staging, StagedQ const* staged, clbp_Error* e)
+{
+	static char detail[256];
+	cl_ulong global_mem = 0, max_alloc = 0;
+	if(clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL)
+		|| clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, NULL))
+		fputs("\nWARNING: couldn't get device memory limits, only printing the plan.", stderr);
+
+	uint16_t arg_cnt = staged->img_arg_cnt;
+	uint16_t stage_cnt = staged->stage_cnt;
+	size_t* byte_cnts = malloc(arg_cnt * sizeof(size_t));
+	// first and last stage each arg is used in, stage_cnt marks args no stage used
+	uint16_t* lifetimes = malloc(2 * arg_cnt * sizeof(uint16_t));
+	if(!byte_cnts || !lifetimes)
+	{
+		free(byte_cnts);
+		free(lifetimes);
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "memory plan"};
+		return;
+	}
+
+	for(uint16_t i = 0; i < arg_cnt; ++i)
+	{
+		lifetimes[2*i] = i < staging->input_img_cnt ? 0 : stage_cnt;
+		lifetimes[2*i+1] = 0;
+	}
+	for(uint16_t s = 0; s < stage_cnt; ++s)
+	{
+		KernStaging const* curr_stage = &staging->kern_stg[s];
+		for(uint16_t j = 0; j < curr_stage->arg_cnt; ++j)
+		{
+			uint16_t idx = curr_stage->arg_idxs[j];
+			if(lifetimes[2*idx] > s)
+				lifetimes[2*idx] = s;
+			lifetimes[2*idx+1] = s;
+		}
+	}
+
+	puts("\n[Device memory plan]\n idx	bytes		size			type		name");
+	size_t total = 0, largest = 0;
+	uint16_t largest_idx = 0;
+	for(uint16_t i = 0; i < arg_cnt; ++i)
+	{
+		ArgStaging const* curr_arg = &staging->img_arg_stg[i];
+		size_t const* size = staged->img_sizes[i].d;
+		byte_cnts[i] = getPixelSize(curr_arg->format) * size[0] * size[1] * size[2];
+		total += byte_cnts[i];
+		if(largest < byte_cnts[i])
+		{
+			largest = byte_cnts[i];
+			largest_idx = i;
+		}
+		// outputs are read back after the last stage so they have to survive the whole queue
+		if(curr_arg->host_flags & CLBP_AHF_OUTPUT)
+			lifetimes[2*i+1] = stage_cnt - 1;
+		printf(" [%u]	%-12zu	{%zu,%zu,%zu}	%-12s	%s\n", i, byte_cnts[i], size[0], size[1], size[2],
+			memTypes[curr_arg->type - CLBP_OFFSET_MEMTYPE], staging->arg_names[i]);
+	}
+
+	// how much would be live at once if args whose stages don't overlap shared memory
+	size_t aliased_peak = 0;
+	uint16_t peak_stage = 0;
+	for(uint16_t s = 0; s < stage_cnt; ++s)
+	{
+		size_t live = 0;
+		for(uint16_t i = 0; i < arg_cnt; ++i)
+			if(lifetimes[2*i] <= s && s <= lifetimes[2*i+1])
+				live += byte_cnts[i];
+		if(aliased_peak < live)
+		{
+			aliased_peak = live;
+			peak_stage = s;
+		}
+	}
+
+	puts(" stage	NDRange			kernel");
+	for(uint16_t s = 0; s < stage_cnt; ++s)
+	{
+		size_t const* range = staged->ranges[s].d;
+		printf(" [%u]	{%zu,%zu,%zu}	%s\n", s, range[0], range[1], range[2], staging->kprog_names[staging->kern_stg[s].kernel_idx]);
+	}
+	printf(" total: %zu bytes, peak live with aliasing: %zu bytes at stage %u\n", total, aliased_peak, peak_stage);
+	if(global_mem)
+		printf(" device: %llu bytes global, %llu bytes max allocation\n", (unsigned long long)global_mem, (unsigned long long)max_alloc);
+
+	if(max_alloc && largest > max_alloc)
+	{
+		snprintf(detail, sizeof(detail), "\"%s\" needs %zu bytes but the largest allocation allowed is %llu bytes",
+			staging->arg_names[largest_idx], largest, (unsigned long long)max_alloc);
+		*e = (clbp_Error){.err_code = CLBP_INSUFFICIENT_DEVICE_MEM, .detail = detail};
+	}
+	else if(global_mem && total > global_mem)
+	{
+		if(aliased_peak <= global_mem)
+			snprintf(detail, sizeof(detail), "needs %zu of %llu bytes, only %zu would be live at once if args with "
+				"non-overlapping stages shared memory, consider reusing args between stages",
+				total, (unsigned long long)global_mem, aliased_peak);
+		else
+			snprintf(detail, sizeof(detail), "needs %zu of %llu bytes and even aliasing args would need %zu",
+				total, (unsigned long long)global_mem, aliased_peak);
+		*e = (clbp_Error){.err_code = CLBP_INSUFFICIENT_DEVICE_MEM, .detail = detail};
+	}
+
+	free(byte_cnts);
+	free(lifetimes);
+}
+
+// one kernel program compile, run on the thread pool by buildKernelProgsFromSource()
+typedef struct {
+	cl_program prog;
+	cl_device_id device;
+	char const* args;
+	cl_int err;
+} CompileJob;
+
+static void compileJob(void* arg)
+{
+	CompileJob* job = arg;
+	// device should be singular and specified or else you can end up with multiple to a context,
+	// error out, and then fail to print the log for the one that actually had the error
+	job->err = clCompileProgram(job->prog, 1, &job->device, job->args, 0, NULL, NULL, NULL, NULL);
+}
+
+static void releaseKernelProgs(cl_program* kprogs, int cnt)
+{
+	for(int i = 0; i < cnt; ++i)
+	{
+		if(kprogs[i])
+			clReleaseProgram(kprogs[i]);
+	}
+	free(kprogs);
+}
+
+// handles using staging data to selectively open kernel program source files and compile and link them into a single program binary,
+// the compiles run concurrently on a thread pool since each one blocks for a while and they don't depend on each other
 //TODO: add support for using pre-calculated ranges as defined constants
 cl_program buildKernelProgsFromSource(cl_context context, cl_device_id device, const char* src_dir, QStaging* staging, const char* args, clbp_Error* e)
 {
 	assert(src_dir && staging && e);
 	char fpath[1024];
+	int kernel_cnt = staging->kernel_cnt;
 	//TODO: add whole program binary caching by checking existence of compiled + linked bin,
 	// and last modified dates match cached version for all sources in list
-	cl_program* kprogs = malloc(staging->kernel_cnt * sizeof(cl_program));
-	if(!kprogs)
+	cl_program* kprogs = calloc(kernel_cnt, sizeof(cl_program));
+	CompileJob* jobs = malloc(kernel_cnt * sizeof(CompileJob));
+	if(!kprogs || !jobs)
 	{
+		free(kprogs);
+		free(jobs);
 		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "cl_program array"};
 		return NULL;
 	}
 
+	// no more workers than there are programs, if the pool can't be started everything is compiled on this thread instead
+	ThreadPool pool = {0};
+	uint16_t thread_cnt = getHostThreadCount();
+	char has_pool = !createThreadPool(&pool, thread_cnt < kernel_cnt ? thread_cnt : kernel_cnt, kernel_cnt);
+
 	// Read kernel program source file and place content into buffer
-	printf("Compiling %i kernel programs.\n", staging->kernel_cnt);
-	for(int i = 0; i < staging->kernel_cnt; ++i)
+	printf("Compiling %i kernel programs.\n", kernel_cnt);
+	for(int i = 0; i < kernel_cnt; ++i)
 	{
 		//TODO: add binary caching/loading, needs to check existence of binary and last modified timestamp of source
 		//append src dir to name and attempt read, unfortunately not smart enough to know about header changes but it'll have to do
 		snprintf(fpath, sizeof(fpath)-1, "%s%s.cl", src_dir, staging->kprog_names[i]);
 		char* k_src = readFileToCstring(fpath, e);
 		if(e->err_code)
-		{
-			free(kprogs);
-			return NULL;
-		}
+			break;
 
 		// Create program from file
 		kprogs[i] = clCreateProgramWithSource(context, 1, (const char**)&k_src, NULL, &e->err_code);
 		free(k_src);
 		if(e->err_code)
 		{
-			free(kprogs);
 			e->detail = "clCreateProgramWithSource";
-			return NULL;
+			break;
 		}
 
 		// Compile program
-		// device should be singular and specified or else you can end up with multiple to a context,
-		// error out, and then fail to print the log for the one that actually had the error
 		printf("Compiling %s\n", fpath);
-		e->err_code = clCompileProgram(kprogs[i], 1, &device, args, 0, NULL, NULL, NULL, NULL);
-		if(e->err_code)
-		{
-			if(e->err_code == CL_COMPILE_PROGRAM_FAILURE)
-				handleClBuildProgram(e->err_code, kprogs[i], device);
-			free(kprogs);
-			e->detail = "clCompileProgram";
-			return NULL;
-		}
+		jobs[i] = (CompileJob){.prog = kprogs[i], .device = device, .args = args};
+		if(has_pool)
+			submitJob(&pool, compileJob, &jobs[i]);
+		else
+			compileJob(&jobs[i]);
+	}
+	// even if a later source failed to load, the compiles already started have to finish before their programs can be released
+	int submitted_cnt = e->err_code ? 0 : kernel_cnt;
+	if(has_pool)
+		destroyThreadPool(&pool);
+
+	// every failed compile gets its log printed, not just the first
+	for(int i = 0; i < submitted_cnt; ++i)
+	{
+		if(!jobs[i].err)
+			continue;
+		snprintf(fpath, sizeof(fpath)-1, "%s%s.cl", src_dir, staging->kprog_names[i]);
+		fprintf(stderr, "@ %s: ", fpath);
+		if(jobs[i].err == CL_COMPILE_PROGRAM_FAILURE)
+			handleClBuildProgram(jobs[i].err, kprogs[i], device);
+		if(!e->err_code)
+			*e = (clbp_Error){.err_code = jobs[i].err, .detail = "clCompileProgram"};
+	}
+	free(jobs);
+	if(e->err_code)
+	{
+		releaseKernelProgs(kprogs, kernel_cnt);
+		return NULL;
 	}
 
 	fputs("Linking... ", stdout);
-	cl_program linked_prog = clLinkProgram(context, 1, &device, args, staging->kernel_cnt, kprogs, NULL, NULL, &e->err_code);
+	cl_program linked_prog = clLinkProgram(context, 1, &device, args, kernel_cnt, kprogs, NULL, NULL, &e->err_code);
+	// the linked program doesn't need the compiled ones anymore
+	releaseKernelProgs(kprogs, kernel_cnt);
 	if(e->err_code)
 	{
-			free(kprogs);
 			if(e->err_code == CL_LINK_PROGRAM_FAILURE)
 				handleClBuildProgram(e->err_code, linked_prog, device);
+			if(linked_prog)
+				clReleaseProgram(linked_prog);
 			e->detail = "clLinkProgram";
 			return NULL;
 	}
 	puts("Done.");
-	//TODO: add release of individual kernel programs
 	return linked_prog;
 }
 
@@ -206,20 +394,110 @@ void instantiateKernels(QStaging const* staging, const cl_program kprog, StagedQ
 		}
 
 		staged->kernels[i] = kernel;
+
+		// kernels that depend on work group layout, ie. one group per list entry, declare it with reqd_work_group_size
+		Size3D* local = &staged->local_ranges[i];
+		if(clGetKernelWorkGroupInfo(kernel, NULL, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(Size3D), local, NULL))
+			*local = (Size3D){{0}};
+	}
+}
+
+// buffers don't have access qualifiers so their access is inferred from the address and type qualifiers instead,
+// global pointers to const are treated as read only and any other global pointer is treated as read/write,
+// returns CL_KERNEL_ARG_ACCESS_NONE if the arg isn't a global pointer or couldn't be queried
+static cl_kernel_arg_access_qualifier getBufferArgAccess(cl_kernel kernel, cl_uint arg_idx)
+{
+	cl_kernel_arg_address_qualifier addr_qual;
+	cl_kernel_arg_type_qualifier type_qual;
+	cl_int err = clGetKernelArgInfo(kernel, arg_idx, CL_KERNEL_ARG_ADDRESS_QUALIFIER, sizeof(addr_qual), &addr_qual, NULL);
+	if(err)
+	{
+		handleClError(err, "clGetKernelArgInfo");
+		return CL_KERNEL_ARG_ACCESS_NONE;
+	}
+	if(addr_qual != CL_KERNEL_ARG_ADDRESS_GLOBAL)	// local, constant and private args aren't backed by a mem object from the arg list
+		return CL_KERNEL_ARG_ACCESS_NONE;
+
+	err = clGetKernelArgInfo(kernel, arg_idx, CL_KERNEL_ARG_TYPE_QUALIFIER, sizeof(type_qual), &type_qual, NULL);
+	if(err)
+	{
+		handleClError(err, "clGetKernelArgInfo");
+		return CL_KERNEL_ARG_ACCESS_READ_WRITE;	// safest assumption, just costs some potential optimization
+	}
+
+	return (type_qual & CL_KERNEL_ARG_TYPE_CONST) ? CL_KERNEL_ARG_ACCESS_READ_ONLY : CL_KERNEL_ARG_ACCESS_READ_WRITE;
+}
+
+// adds the mem flags needed for a kernel arg with the given access qualifier to the arg's staging data, shared by the inferred
+// and the cached paths, returns false if the access qualifier doesn't belong to an image or global buffer
+static char applyArgAccess(ArgStaging* curr_arg, cl_kernel_arg_access_qualifier access_qual, char is_default_output)
+{
+	cl_mem_flags* curr_flags = &curr_arg->flags;
+	switch(access_qual)
+	{
+	// this can cause situations where mutually exclusive flags are set, however those get fixed in instantiateImgArgs()
+	// right before clCreateImage() is called and is much simpler to reason about if there is only a read flag and a write
+	// flag which can be checked at the end if they're both set and then be cleared
+	case CL_KERNEL_ARG_ACCESS_READ_ONLY:
+		// check for read before write, if none of these flags are set, nothing* could have written to it before this read occured
+		// *except writing to it from the same kernel but that's undefined behavior and not portable and harder to check so I'm not checking that
+		if(!(*curr_flags & (CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_WRITE_ONLY)))
+			fputs("\nWARNING: reading arg before writing to it.", stderr);
+		*curr_flags |= CL_MEM_READ_ONLY;
+		break;
+	case CL_KERNEL_ARG_ACCESS_READ_WRITE:
+		*curr_flags |= CL_MEM_READ_ONLY;
+	case CL_KERNEL_ARG_ACCESS_WRITE_ONLY:
+		*curr_flags |= CL_MEM_WRITE_ONLY;
+		if(is_default_output)
+		{
+			*curr_flags |= CL_MEM_HOST_READ_ONLY;
+			curr_arg->host_flags |= CLBP_AHF_OUTPUT;
+			curr_arg->readback_period = 1;
+		}
+		// the readback packing kernel also reads outputs so they end up read/write on the device
+		if(*curr_flags & CL_MEM_HOST_READ_ONLY)
+			*curr_flags |= CL_MEM_READ_ONLY;
+		break;
+//	case CL_KERNEL_ARG_ACCESS_NONE:	//not an image or pipe, access qualifier doesn't apply
+	default:
+		fputs("\nWARNING: non-mem object arg requested. Currently only image and global buffer args are supported.", stderr);
+		return 0;
 	}
+	return 1;
+}
+
+// if the manifest doesn't mark any outputs, anything written by the last stage is read back every frame
+static char hasOutputs(QStaging const* staging)
+{
+	char has_outputs = 0;
+	for(int i = 0; i < staging->img_arg_cnt; ++i)
+		has_outputs |= staging->img_arg_stg[i].host_flags & CLBP_AHF_OUTPUT;
+	return has_outputs;
 }
 
 // infers the access qualifiers of the image args as well as verifies that type data specified matches what the kernels expect of it
 // meant to be run once after kernels have been instantiated for at least 1 staged queue, additional staged queues don't
 // require re-runs of inferArgAccessAndVerifyFormats() since data extracted from the kernel instance args shouldn't change
 //TODO: many of the warnings would interupt the printing of the argument info, see what can be done to tidy up so that they print after the line is done
-void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged)
+void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged, char const* cache_fname)
 {
 	printf("[Verifying kernel args]");
+	char has_outputs = hasOutputs(staging);
+	FILE* cache = NULL;
+	if(cache_fname)
+	{
+		cache = fopen(cache_fname, "w");
+		if(cache)
+			fputs(ARG_CACHE_HEADER, cache);
+		else
+			perror("\nWARNING: couldn't write the arg access cache");
+	}
+
 	// for each stage
 	for(int i = 0; i < staged->stage_cnt; ++i)
 	{
-		char is_last_stage = (i+1 == staged->stage_cnt);	// anything written by the last stage gets set to host readable
+		char is_default_output = !has_outputs && (i+1 == staged->stage_cnt);
 		cl_kernel curr_kern = staged->kernels[i];
 		char const* kprog_name = staging->kprog_names[staging->kern_stg[i].kernel_idx];
 		cl_uint arg_cnt;
@@ -228,13 +506,24 @@ void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged)
 		printf("\n[%i] {%lli,%lli,%lli}	%s ",
 			i, curr_range[0], curr_range[1], curr_range[2], kprog_name);
 		err = clGetKernelInfo(curr_kern, CL_KERNEL_NUM_ARGS, sizeof(arg_cnt), &arg_cnt, NULL);
-		staging->kern_stg[i].arg_cnt = arg_cnt;
 		if(err)
 		{
 			handleClError(err, "clGetKernelInfo");
 			fputs("\nWARNING: couldn't get CL_KERNEL_NUM_ARGS. Skipping argument access qualifier inferencing and format verification.", stderr);
+			if(cache)	// an arg count of 0 never matches so the cache can't be used in place of this verification
+				fprintf(cache, "\n%s 0", kprog_name);
 			continue;
 		}
+		// only as many args as the manifest listed can be bound, any left unset fail at enqueue
+		if(arg_cnt != staging->kern_stg[i].arg_cnt)
+		{
+			fprintf(stderr, "\nWARNING: kernel takes %u args but the manifest lists %u.", arg_cnt, staging->kern_stg[i].arg_cnt);
+			if(arg_cnt > staging->kern_stg[i].arg_cnt)
+				arg_cnt = staging->kern_stg[i].arg_cnt;
+		}
+		staging->kern_stg[i].arg_cnt = arg_cnt;
+		if(cache)
+			fprintf(cache, "\n%s %u", kprog_name, arg_cnt);
 		// for each argument of the current kernel
 		for(cl_uint j = 0; j < arg_cnt; ++j)
 		{
@@ -251,35 +540,15 @@ void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged)
 			{
 				handleClError(err, "clGetKernelArgInfo");
 				fputs("\nWARNING: couldn't get CL_KERNEL_ARG_ACCESS_QUALIFIER. Skipping argument access qualifier inferencing.", stderr);
+				access_qual = 0;	// not a valid qualifier, cached as skipped
 			}
-			else
-			{
-				cl_mem_flags* curr_flags = &curr_arg->flags;
-				switch(access_qual)
-				{
-				// this can cause situations where mutually exclusive flags are set, however those get fixed in instantiateImgArgs()
-				// right before clCreateImage() is called and is much simpler to reason about if there is only a read flag and a write
-				// flag which can be checked at the end if they're both set and then be cleared
-				case CL_KERNEL_ARG_ACCESS_READ_ONLY:
-					// check for read before write, if none of these flags are set, nothing* could have written to it before this read occured
-					// *except writing to it from the same kernel but that's undefined behavior and not portable and harder to check so I'm not checking that
-					if(!(*curr_flags & (CL_MEM_WRITE_ONLY | CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_WRITE_ONLY)))
-						fputs("\nWARNING: reading arg before writing to it.", stderr);
-					*curr_flags |= CL_MEM_READ_ONLY;
-					break;
-				case CL_KERNEL_ARG_ACCESS_READ_WRITE:
-					*curr_flags |= CL_MEM_READ_ONLY;
-				case CL_KERNEL_ARG_ACCESS_WRITE_ONLY:
-					*curr_flags |= CL_MEM_WRITE_ONLY;
-					if(is_last_stage)
-						*curr_flags |= CL_MEM_HOST_READ_ONLY;
-					break;
-			//	case CL_KERNEL_ARG_ACCESS_NONE:	//not an image or pipe, access qualifier doesn't apply
-				default:
-					fputs("\nWARNING: non-image arg requested. Currently no non-image support implemented.", stderr);
-					continue;	//TODO: currently doesn't handle non-image types, this is just placeholder code that would probably break if executed
-				}
-			}
+			else if(access_qual == CL_KERNEL_ARG_ACCESS_NONE)	// not an image or pipe, might still be a buffer
+				access_qual = getBufferArgAccess(curr_kern, j);
+
+			if(cache)
+				fprintf(cache, " %x", access_qual);
+			if(access_qual && !applyArgAccess(curr_arg, access_qual, is_default_output))
+				continue;
 
 			char arg_metadata[64];	// although only 4 entries are needed, reading the name will fail if there's not enough room for the whole name
 			err = clGetKernelArgInfo(curr_kern, j, CL_KERNEL_ARG_TYPE_NAME, sizeof(arg_metadata), arg_metadata, NULL);
@@ -291,7 +560,12 @@ void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged)
 			}
 
 			printf("-> (%s) ", arg_metadata);
-			enum clMemType mem_type = getStringIndex(memTypes, arg_metadata) + CLBP_OFFSET_MEMTYPE;
+			enum clMemType mem_type;
+			// pointer type names are the only ones ending in '*' and the only pointers that make it here are global
+			if(arg_metadata[strlen(arg_metadata) - 1] == '*')
+				mem_type = CLBP_BUFFER;
+			else
+				mem_type = getStringIndex(memTypes, arg_metadata) + CLBP_OFFSET_MEMTYPE;
 
 			// I attach type data in a similar style to Hungarian notation to the names so that the expected type backing of
 			// the image is stored with the kernel itself and can be interpreted here by querying the name.
@@ -334,62 +608,161 @@ void inferArgAccessAndVerifyFormats(QStaging* staging, StagedQ const* staged)
 				//NOTE: may need to add special processing for 3 channel items since those aren't required to be supported by the OpenCL spec
 		}
 	}
+	if(cache)
+	{
+		fputc('\n', cache);
+		fclose(cache);
+	}
 	putchar('\n');
 }
 
+// release build replacement for inferArgAccessAndVerifyFormats(), applies the access qualifiers it saved to cache_fname without
+// querying the kernels so they can be built without -cl-kernel-arg-info, none of the format verification is repeated
+void applyCachedArgAccess(QStaging* staging, char const* cache_fname, clbp_Error* e)
+{
+	assert(staging && cache_fname && e);
+	FILE* cache = fopen(cache_fname, "r");
+	if(!cache)
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)cache_fname};
+		return;
+	}
+
+	printf("[Applying cached kernel arg access]\n");
+	char has_outputs = hasOutputs(staging);
+	char line[64];
+	char is_valid = fgets(line, sizeof(line), cache) && !strcmp(line, ARG_CACHE_HEADER"\n");
+	for(int i = 0; is_valid && i < staging->stage_cnt; ++i)
+	{
+		KernStaging* curr_kstaging = &staging->kern_stg[i];
+		char const* kprog_name = staging->kprog_names[curr_kstaging->kernel_idx];
+		char is_default_output = !has_outputs && (i+1 == staging->stage_cnt);
+		char name[256];
+		unsigned int arg_cnt;
+		// stages are cached in order so any edit to the stages array since the cache was made gets caught here
+		if(fscanf(cache, "%255s %u", name, &arg_cnt) != 2 || strcmp(name, kprog_name) || arg_cnt != curr_kstaging->arg_cnt)
+		{
+			is_valid = 0;
+			break;
+		}
+		for(unsigned int j = 0; j < arg_cnt; ++j)
+		{
+			unsigned int access_qual;
+			if(fscanf(cache, " %x", &access_qual) != 1)
+			{
+				is_valid = 0;
+				break;
+			}
+			if(access_qual)
+				applyArgAccess(&staging->img_arg_stg[curr_kstaging->arg_idxs[j]], access_qual, is_default_output);
+		}
+	}
+	fclose(cache);
+	if(!is_valid)
+		*e = (clbp_Error){.err_code = CLBP_INVALID_ARG_CACHE, .detail = (char*)cache_fname};
+}
+
+// creates the device memory for arg idx at the given size from its staging data, shared by instantiateImgArgs() and
+// anything that needs to recreate a single arg after its size changed
+cl_mem createArgMem(cl_context context, QStaging const* staging, uint16_t idx, size_t const* size, clbp_Error* e)
+{
+	ArgStaging const* curr_arg = &staging->img_arg_stg[idx];
+	cl_mem_flags flags = curr_arg->flags;
+	cl_mem mem;
+
+	// read only and write only flags are mutually exclusive so if they both occur,
+	// clear them to go back to default read/write behavior
+	if((flags & CLBP_MEM_RW) == CLBP_MEM_RW)
+		flags ^= CLBP_MEM_RW;
+
+	if(!(flags & (CL_MEM_HOST_READ_ONLY | CL_MEM_HOST_WRITE_ONLY)))	// hard-coded inputs get written through a mapping
+		flags |= CL_MEM_HOST_NO_ACCESS;
+
+	// only used if a hard-coded input was explicitly flagged to be initialized from or wrap host memory
+	void* host_ptr = (idx < staging->input_img_cnt && (flags & (CL_MEM_COPY_HOST_PTR | CL_MEM_USE_HOST_PTR))) ? staging->input_imgs[idx] : NULL;
+	if(curr_arg->type == CL_MEM_OBJECT_BUFFER)
+	{	// buffers are sized by element count with the format describing a single element
+		size_t byte_cnt = getPixelSize(curr_arg->format) * size[0] * size[1] * size[2];
+		mem = clCreateBuffer(context, flags, byte_cnt, host_ptr, &e->err_code);
+		if(e->err_code)
+			e->detail = "clCreateBuffer";
+		return mem;
+	}
+
+	cl_image_desc desc = {
+		.image_type = curr_arg->type,
+		.image_width = size[0],
+		.image_height = size[1],
+		.image_depth = size[2],
+		.image_array_size = 1,
+		.image_row_pitch = 0,
+		.image_slice_pitch = 0,
+		.num_mip_levels = 0,
+		.num_samples = 0,
+		.buffer = NULL
+	};
+	mem = clCreateImage(context, flags, &curr_arg->format, &desc, host_ptr, &e->err_code);
+	if(e->err_code)
+		e->detail = "clCreateImage";
+	return mem;
+}
+
+// true if every stage that uses arg idx is sampled, hard-coded inputs are written every frame so they never are
+static char isOnlySampled(QStaging const* staging, uint16_t idx)
+{
+	if(idx < staging->input_img_cnt)
+		return 0;
+	char is_used = 0;
+	for(int i = 0; i < staging->stage_cnt; ++i)
+	{
+		KernStaging const* curr_kstaging = &staging->kern_stg[i];
+		for(int j = 0; j < curr_kstaging->arg_cnt; ++j)
+		{
+			if(curr_kstaging->arg_idxs[j] != idx)
+				continue;
+			if(curr_kstaging->sample_period == 1)
+				return 0;
+			is_used = 1;
+		}
+	}
+	return is_used;
+}
+
 // fills in the ArgTracker according to the arg staging data in staging,
 // assumes the ArgTracker was allocated big enough not to overrun it and
 // is pre-populated with the expected number of hard-coded input entries
 // such that it may add the first new entry at input_img_cnt
-// returns the max number of bytes needed for reading out of any of the host readable buffers
+// returns the max number of bytes needed for reading out of any of the host readable buffers,
+// args only used by sampled stages are left NULL for scheduleSampledStages() but still count towards it
 size_t instantiateImgArgs(cl_context context, QStaging const* staging, StagedQ* staged, clbp_Error* e)
 {
 	size_t max_out_sz = 0;
-	cl_mem* img_args = staged->img_args;
 	for(int i = 0; i < staging->img_arg_cnt; ++i)
 	{
-		ArgStaging* curr_arg = &staging->img_arg_stg[i];
-		cl_mem_flags flags = curr_arg->flags;
-		size_t* size = staged->img_sizes[i].d;
-		cl_image_desc desc = {
-			.image_type = curr_arg->type,
-			.image_width = size[0],
-			.image_height = size[1],
-			.image_depth = size[2],
-			.image_array_size = 1,
-			.image_row_pitch = 0,
-			.image_slice_pitch = 0,
-			.num_mip_levels = 0,
-			.num_samples = 0,
-			.buffer = NULL
-		};
-
-		// read only and write only flags are mutually exclusive so if they both occur,
-		// clear them to go back to default read/write behavior
-		if((flags & CLBP_MEM_RW) == CLBP_MEM_RW)
-			flags ^= CLBP_MEM_RW;
-
-		if(flags & (CL_MEM_HOST_READ_ONLY))
+		ArgStaging const* curr_arg = &staging->img_arg_stg[i];
+		size_t const* size = staged->img_sizes[i].d;
+		if(curr_arg->flags & CL_MEM_HOST_READ_ONLY)
 		{	// calculate output size
 			size_t curr_size = getPixelSize(curr_arg->format);
 			curr_size *= (size_t)size[0] * size[1] * size[2];
 			if(max_out_sz < curr_size)
 				max_out_sz = curr_size;
 		}
-		else// if(!(curr_arg->flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR))) //I suspect these flags might qualify too
-			flags |= CL_MEM_HOST_NO_ACCESS;
 
-		img_args[i] = clCreateImage(context, flags, &curr_arg->format, &desc, (i < staging->input_img_cnt) ? staging->input_imgs[i] : NULL, &e->err_code);
-		if(e->err_code)
+		staged->arg_host_flags[i] = curr_arg->host_flags;
+		staged->readback_periods[i] = curr_arg->readback_period;
+		if(isOnlySampled(staging, i))
 		{
-			e->detail = "clCreateImage";
-			return 0;
+			staged->arg_host_flags[i] |= CLBP_AHF_DEFERRED | CLBP_AHF_IDLE;
+			continue;
 		}
+		staged->img_args[i] = createArgMem(context, staging, i, size, e);
+		if(e->err_code)
+			return 0;
 	}
 	return max_out_sz;
 }
 
-//TODO: add support for returning a list of host readable buffers
 void setKernelArgs(QStaging const* staging, StagedQ* staged, clbp_Error* e)
 {
 	//for each stage
@@ -400,6 +773,8 @@ void setKernelArgs(QStaging const* staging, StagedQ* staged, clbp_Error* e)
 		for(int j = 0; j < curr_kstaging->arg_cnt; ++j)
 		{
 			uint16_t arg_idx = curr_kstaging->arg_idxs[j];
+			if(!staged->img_args[arg_idx])	// deferred, bound once scheduleSampledStages() creates it
+				continue;
 			e->err_code = clSetKernelArg(curr_kern, j, sizeof(cl_mem), &staged->img_args[arg_idx]);
 			if(e->err_code)
 			{
@@ -412,6 +787,196 @@ void setKernelArgs(QStaging const* staging, StagedQ* staged, clbp_Error* e)
 	}
 }
 
+// sets arg idx again on every stage that uses it, for after it was replaced in staged->img_args
+void rebindArg(QStaging const* staging, StagedQ const* staged, uint16_t idx, clbp_Error* e)
+{
+	if(!staged->img_args[idx])	// deferred args that were never created have nothing to bind
+		return;
+	for(int i = 0; i < staged->stage_cnt; ++i)
+	{
+		KernStaging const* curr_kstaging = &staging->kern_stg[i];
+		for(int j = 0; j < curr_kstaging->arg_cnt; ++j)
+		{
+			if(curr_kstaging->arg_idxs[j] != idx)
+				continue;
+			e->err_code = clSetKernelArg(staged->kernels[i], j, sizeof(cl_mem), &staged->img_args[idx]);
+			if(e->err_code)
+			{
+				fprintf(stderr, "@ stage %i (%s), arg %i (%s): ",
+					i, staging->kprog_names[curr_kstaging->kernel_idx], j, staging->arg_names[idx]);
+				e->detail = "clSetKernelArg";
+				return;
+			}
+		}
+	}
+}
+
+void requestReadback(StagedQ* staged, uint16_t idx)
+{
+	if(staged->arg_host_flags[idx] & CLBP_AHF_OUTPUT)
+		staged->arg_host_flags[idx] |= CLBP_AHF_READ_REQUESTED;
+}
+
+char consumeReadback(StagedQ* staged, uint16_t idx, uint32_t frame_idx)
+{
+	uint8_t* flags = &staged->arg_host_flags[idx];
+	// on demand requests for outputs of skipped stages stay pending until a frame produces them
+	if(!(*flags & CLBP_AHF_OUTPUT) || (*flags & CLBP_AHF_IDLE))
+		return 0;
+
+	uint16_t period = staged->readback_periods[idx];
+	char is_due = (*flags & CLBP_AHF_READ_REQUESTED) || (period && frame_idx % period == 0);
+	*flags &= ~CLBP_AHF_READ_REQUESTED;
+	return is_due;
+}
+
+void triggerStage(StagedQ* staged, uint16_t stage_idx)
+{
+	if(staged->sample_periods[stage_idx] != 1)
+		staged->stage_host_flags[stage_idx] |= CLBP_SHF_TRIGGERED;
+}
+
+// picks which sampled stages run on frame_idx, then creates any deferred args they use that don't exist yet and marks the
+// ones none of them use as idle, deferred args are kept once created so later sampled frames reuse them
+void scheduleSampledStages(cl_context context, QStaging const* staging, StagedQ* staged, uint32_t frame_idx, clbp_Error* e)
+{
+	char has_sampled = 0;
+	for(int i = 0; i < staged->stage_cnt; ++i)
+	{
+		uint16_t period = staged->sample_periods[i];
+		if(period == 1)
+			continue;
+		uint8_t* flags = &staged->stage_host_flags[i];
+		char is_due = (*flags & CLBP_SHF_TRIGGERED) || (period && frame_idx % period == 0);
+		*flags = is_due ? 0 : CLBP_SHF_SKIP;
+		has_sampled = 1;
+	}
+	if(!has_sampled)
+		return;
+
+	for(uint16_t i = 0; i < staged->img_arg_cnt; ++i)
+	{
+		if(staged->arg_host_flags[i] & CLBP_AHF_DEFERRED)
+			staged->arg_host_flags[i] |= CLBP_AHF_IDLE;
+	}
+	for(int i = 0; i < staged->stage_cnt; ++i)
+	{
+		if(staged->stage_host_flags[i] & CLBP_SHF_SKIP)
+			continue;
+		KernStaging const* curr_kstaging = &staging->kern_stg[i];
+		for(int j = 0; j < curr_kstaging->arg_cnt; ++j)
+		{
+			uint16_t idx = curr_kstaging->arg_idxs[j];
+			staged->arg_host_flags[idx] &= ~CLBP_AHF_IDLE;
+			if(staged->img_args[idx])
+				continue;
+			staged->img_args[idx] = createArgMem(context, staging, idx, staged->img_sizes[idx].d, e);
+			if(!e->err_code)
+				rebindArg(staging, staged, idx, e);
+			if(e->err_code)
+				return;
+		}
+	}
+}
+
+// zero fills any args flagged with CLBP_AHF_CLEAR and then enqueues every stage of the staged queue in order,
+// skipping the sampled stages that scheduleSampledStages() didn't pick for this frame along with their idle args
+void enqueueStagedQ(cl_command_queue queue, StagedQ const* staged, clbp_Error* e)
+{
+	cl_uint4 const zero = {{0}};	// 16 bytes of zeros works as the fill color for any image channel type
+	for(int i = 0; i < staged->img_arg_cnt; ++i)
+	{
+		if((staged->arg_host_flags[i] & (CLBP_AHF_CLEAR | CLBP_AHF_IDLE)) != CLBP_AHF_CLEAR)
+			continue;
+
+		size_t const* size = staged->img_sizes[i].d;
+		cl_mem_object_type type;
+		e->err_code = clGetMemObjectInfo(staged->img_args[i], CL_MEM_TYPE, sizeof(type), &type, NULL);
+		if(e->err_code)
+		{
+			e->detail = "clGetMemObjectInfo->CL_MEM_TYPE";
+			return;
+		}
+
+		if(type == CL_MEM_OBJECT_BUFFER)
+		{
+			size_t byte_cnt;
+			e->err_code = clGetMemObjectInfo(staged->img_args[i], CL_MEM_SIZE, sizeof(byte_cnt), &byte_cnt, NULL);
+			// the size has to be a multiple of the pattern size which has to be a power of 2, buffers of 1 or 2 byte or
+			// 3 channel elements don't always fit a fixed pattern so use the widest one that divides the size
+			size_t pattern_sz = byte_cnt & -byte_cnt;
+			if(pattern_sz > sizeof(zero))
+				pattern_sz = sizeof(zero);
+			if(!e->err_code)
+				e->err_code = clEnqueueFillBuffer(queue, staged->img_args[i], &zero, pattern_sz, 0, byte_cnt, 0, NULL, NULL);
+			e->detail = "clEnqueueFillBuffer";
+		}
+		else
+		{
+			e->err_code = clEnqueueFillImage(queue, staged->img_args[i], &zero, (size_t[3]){0}, size, 0, NULL, NULL);
+			e->detail = "clEnqueueFillImage";
+		}
+		if(e->err_code)
+			return;
+	}
+
+	uint16_t read_idx = CLBP_NO_COUNT_ARG;	// count arg last read back this frame
+	cl_uint cnt = 0;
+	for(int i = 0; i < staged->stage_cnt; ++i)
+	{
+		if(staged->stage_host_flags[i] & CLBP_SHF_SKIP)
+			continue;
+		size_t* range = staged->ranges[i].d;
+		size_t* local = staged->local_ranges[i].d;
+		size_t padded[2];
+		uint16_t count_idx = staged->count_args[i];
+		if(count_idx != CLBP_NO_COUNT_ARG)
+		{
+			// waits for the stages before it, consecutive stages counted by the same arg share the read since nothing
+			// between them is expected to change it
+			if(count_idx != read_idx)
+			{
+				e->err_code = clEnqueueReadBuffer(queue, staged->img_args[count_idx], CL_TRUE, 0, sizeof(cnt), &cnt, 0, NULL, NULL);
+				if(e->err_code)
+				{
+					fprintf(stderr, "@ stage %i: ", i);
+					e->detail = "clEnqueueReadBuffer";
+					return;
+				}
+				read_idx = count_idx;
+			}
+			if(!cnt)	// nothing to do, the kernel would only bounds check every work item
+				continue;
+			// rounded up so the implementation can still pick full work groups, the kernel bounds checks against the count
+			size_t granule = local[0] ? local[0] : CLBP_COUNT_GRANULE;
+			padded[0] = ((size_t)cnt + granule - 1) / granule * granule;
+			if(padded[0] < range[0])
+			{
+				padded[1] = range[1];
+				range = padded;
+			}
+		}
+		else
+			read_idx = CLBP_NO_COUNT_ARG;
+		if(local[0])
+		{
+			// the range has to be a multiple of a required work group size, kernels bounds check the padding themselves
+			padded[0] = (range[0] + local[0] - 1) / local[0] * local[0];
+			padded[1] = (range[1] + local[1] - 1) / local[1] * local[1];
+			range = padded;
+		}
+		else
+			local = NULL;
+		e->err_code = clEnqueueNDRangeKernel(queue, staged->kernels[i], 2, NULL, range, local, 0, NULL, NULL);
+		if(e->err_code)
+		{
+			fprintf(stderr, "@ stage %i: ", i);
+			e->detail = "clEnqueueNDRangeKernel";
+			return;
+		}
+	}
+}
+
 // reads an image from file with the requested number of channels and attaches the data to the staging object
 // must have the format and type pre-populated with a suitable way to interpret the raw image data
 void inputImagesFromFiles(char const** fnames, QStaging* staging, clbp_Error* e)
@@ -437,11 +1002,281 @@ void inputImagesFromFiles(char const** fnames, QStaging* staging, clbp_Error* e)
 
 		printf("loaded %s, %i*%i image with %i channel(s), using %i channel(s).\n", fnames[i], x, y, ch, channels);
 
-		curr_img->flags = CL_MEM_COPY_HOST_PTR;
+		curr_img->flags = CLBP_INPUT_MEM_FLAGS;
+	}
+}
+
+void writeInputImage(cl_command_queue queue, StagedQ const* staged, uint16_t idx, uint8_t const* data, clbp_Error* e)
+{
+	cl_mem img = staged->img_args[idx];
+	cl_image_format format;
+	e->err_code = clGetImageInfo(img, CL_IMAGE_FORMAT, sizeof(format), &format, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetImageInfo->CL_IMAGE_FORMAT";
+		return;
+	}
+
+	size_t const* size = staged->img_sizes[idx].d;
+	size_t row_pitch, slice_pitch;
+	// invalidating the region lets the runtime skip making the old contents visible to the host first
+	uint8_t* mapped = clEnqueueMapImage(queue, img, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, (size_t[3]){0}, size,
+		&row_pitch, &slice_pitch, 0, NULL, NULL, &e->err_code);
+	if(e->err_code)
+	{
+		e->detail = "clEnqueueMapImage";
+		return;
+	}
+
+	// mapped rows may be padded so copy row by row unless they happen to be tightly packed
+	size_t row_len = getPixelSize(format) * size[0];
+	if(row_pitch == row_len && (size[2] == 1 || slice_pitch == row_len * size[1]))
+		memcpy(mapped, data, row_len * size[1] * size[2]);
+	else
+	{
+		for(size_t z = 0; z < size[2]; ++z)
+		{
+			for(size_t y = 0; y < size[1]; ++y)
+			{
+				memcpy(mapped + z * slice_pitch + y * row_pitch, data, row_len);
+				data += row_len;
+			}
+		}
+	}
+
+	e->err_code = clEnqueueUnmapMemObject(queue, img, mapped, 0, NULL, NULL);
+	if(e->err_code)
+		e->detail = "clEnqueueUnmapMemObject";
+}
+
+// compacted ellipse lists from most to least refined, later stages write the same record layout
+static char const* const ellipse_lists[][2] = {
+	{"merged_cnt", "merged_list"},
+	{"verified_cnt", "verified_list"},
+	{"ellipse_cnt", "ellipse_list"}
+};
+
+char findEllipseListArgs(char const** arg_names, StagedQ const* staged, int* cnt_idx, int* list_idx)
+{
+	for(size_t i = 0; i < sizeof(ellipse_lists) / sizeof(ellipse_lists[0]); ++i)
+	{
+		*cnt_idx = getStringIndex(arg_names, ellipse_lists[i][0]);
+		*list_idx = getStringIndex(arg_names, ellipse_lists[i][1]);
+		if(*cnt_idx >= 0 && *list_idx >= 0 && (staged->arg_host_flags[*list_idx] & CLBP_AHF_OUTPUT))
+			return 1;
+	}
+	*cnt_idx = -1;
+	*list_idx = -1;
+	return 0;
+}
+
+uint32_t readEllipseList(cl_command_queue queue, StagedQ const* staged, uint16_t cnt_idx, uint16_t list_idx, EllipseRecord* out, uint32_t max_cnt, uint32_t* total_cnt, clbp_Error* e)
+{
+	cl_uint cnt;
+	e->err_code = clEnqueueReadBuffer(queue, staged->img_args[cnt_idx], CL_TRUE, 0, sizeof(cnt), &cnt, 0, NULL, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clEnqueueReadBuffer";
+		return 0;
+	}
+	*total_cnt = cnt;
+
+	// the device keeps counting past the end of the list so clamp to what actually got written
+	size_t list_size;
+	e->err_code = clGetMemObjectInfo(staged->img_args[list_idx], CL_MEM_SIZE, sizeof(list_size), &list_size, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetMemObjectInfo->CL_MEM_SIZE";
+		return 0;
+	}
+	if(cnt > list_size / sizeof(EllipseRecord))
+		cnt = list_size / sizeof(EllipseRecord);
+	if(cnt > max_cnt)
+		cnt = max_cnt;
+	if(!cnt)
+		return 0;
+
+	e->err_code = clEnqueueReadBuffer(queue, staged->img_args[list_idx], CL_TRUE, 0, cnt * sizeof(EllipseRecord), out, 0, NULL, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clEnqueueReadBuffer";
+		return 0;
+	}
+	return cnt;
+}
+
+// picks the pack_uchar.cl mode and shift that reproduce what readImageAsCharArr() does for the channel type
+static int getPackMode(cl_channel_type type, int* shift)
+{
+	enum {PACK_UNORM, PACK_SNORM, PACK_UINT, PACK_INT, PACK_FLOAT, PACK_HALF};	// must match the defines in pack_uchar.cl
+	*shift = 0;
+	switch(type)
+	{
+	case CLBP_SNORM_INT8:
+	case CLBP_SNORM_INT16:
+		return PACK_SNORM;
+	case CLBP_UNSIGNED_INT32:
+		*shift += 16;
+	case CLBP_UNSIGNED_INT16:
+		*shift += 8;
+	case CLBP_UNSIGNED_INT8:
+		return PACK_UINT;
+	case CLBP_SIGNED_INT32:
+		*shift += 16;
+	case CLBP_SIGNED_INT16:
+		*shift += 8;
+	case CLBP_SIGNED_INT8:
+		return PACK_INT;
+	case CLBP_FLOAT:
+		return PACK_FLOAT;
+	case CLBP_HALF_FLOAT:
+		return PACK_HALF;
+	default:	// remaining unorm types including the packed ones
+		return PACK_UNORM;
 	}
 }
 
-// converts format of data to char array compatible read,
+// builds pack_uchar.cl from src_dir with defines matching the format of the image at idx so that it can be converted to
+// 8 bits per channel on the device, pr->kernel is left NULL without an error if the arg isn't a 2D image
+void createPackedReadback(cl_context context, cl_device_id device, char const* src_dir, char const* args, StagedQ const* staged, uint16_t idx, PackedReadback* pr, clbp_Error* e)
+{
+	assert(src_dir && staged && pr && e);
+	*pr = (PackedReadback){0};
+	cl_mem img = staged->img_args[idx];
+	if(!img)	// deferred args don't exist yet to take the format from
+		return;
+	cl_mem_object_type type;
+	e->err_code = clGetMemObjectInfo(img, CL_MEM_TYPE, sizeof(type), &type, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetMemObjectInfo->CL_MEM_TYPE";
+		return;
+	}
+	if(type != CL_MEM_OBJECT_IMAGE2D)
+		return;
+
+	cl_image_format format;
+	e->err_code = clGetImageInfo(img, CL_IMAGE_FORMAT, sizeof(format), &format, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetImageInfo->CL_IMAGE_FORMAT";
+		return;
+	}
+
+	char const* swizzle = "xyzw";
+	uint8_t channel_cnt = getChannelCount(format.image_channel_order);
+	switch(format.image_channel_order)
+	{
+	case CL_A:
+		swizzle = "wyzw";	// alpha only, move it to the first channel
+		break;
+	case CL_RA:
+		swizzle = "xwzw";
+		break;
+	}
+	if(format.image_channel_data_type == CL_UNORM_INT_101010_2)
+		channel_cnt = 4;
+	if(!channel_cnt)
+		return;
+
+	int shift;
+	int mode = getPackMode(format.image_channel_data_type, &shift);
+	char build_args[1024];
+	snprintf(build_args, sizeof(build_args), "%s -DPACK_MODE=%i -DCHANNEL_CNT=%i -DSHIFT=%i -DSWIZZLE=%s",
+		args ? args : "", mode, channel_cnt, shift, swizzle);
+
+	char fpath[1024];
+	snprintf(fpath, sizeof(fpath)-1, "%spack_uchar.cl", src_dir);
+	char* k_src = readFileToCstring(fpath, e);
+	if(e->err_code)
+		return;
+
+	cl_program prog = clCreateProgramWithSource(context, 1, (const char**)&k_src, NULL, &e->err_code);
+	free(k_src);
+	if(e->err_code)
+	{
+		e->detail = "clCreateProgramWithSource";
+		return;
+	}
+
+	printf("Building %s for readback of arg %u\n", fpath, idx);
+	e->err_code = clBuildProgram(prog, 1, &device, build_args, NULL, NULL);
+	if(e->err_code)
+	{
+		if(e->err_code == CL_BUILD_PROGRAM_FAILURE)
+			handleClBuildProgram(e->err_code, prog, device);
+		clReleaseProgram(prog);
+		e->detail = "clBuildProgram";
+		return;
+	}
+
+	// the kernel keeps the program alive for as long as it needs it
+	pr->kernel = clCreateKernel(prog, "pack_uchar", &e->err_code);
+	clReleaseProgram(prog);
+	if(e->err_code)
+	{
+		e->detail = "clCreateKernel";
+		return;
+	}
+
+	pr->channel_cnt = channel_cnt;
+	size_t const* size = staged->img_sizes[idx].d;
+	cl_mem packed = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, size[0] * size[1] * channel_cnt, NULL, &e->err_code);
+	if(e->err_code)
+	{
+		e->detail = "clCreateBuffer";
+		releasePackedReadback(pr);
+		return;
+	}
+
+	setPackedReadbackTarget(staged, idx, pr, packed, e);
+	if(e->err_code)
+		releasePackedReadback(pr);
+}
+
+// points the packed readback at the current image at idx and at packed, which must hold its size in packed pixels,
+// the previous packed buffer is replaced without being released
+void setPackedReadbackTarget(StagedQ const* staged, uint16_t idx, PackedReadback* pr, cl_mem packed, clbp_Error* e)
+{
+	size_t const* size = staged->img_sizes[idx].d;
+	pr->packed = packed;
+	pr->range[0] = size[0];
+	pr->range[1] = size[1];
+	pr->byte_cnt = size[0] * size[1] * pr->channel_cnt;
+
+	e->err_code = clSetKernelArg(pr->kernel, 0, sizeof(cl_mem), &staged->img_args[idx]);
+	if(!e->err_code)
+		e->err_code = clSetKernelArg(pr->kernel, 1, sizeof(cl_mem), &pr->packed);
+	if(e->err_code)
+		e->detail = "clSetKernelArg";
+}
+
+// packs the image on the device and reads back only the packed bytes, out must hold at least pr->byte_cnt bytes
+void readPackedImage(cl_command_queue queue, PackedReadback const* pr, uint8_t* out, clbp_Error* e)
+{
+	assert(pr && pr->kernel && out && e);
+	e->err_code = clEnqueueNDRangeKernel(queue, pr->kernel, 2, NULL, pr->range, NULL, 0, NULL, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clEnqueueNDRangeKernel";
+		return;
+	}
+
+	e->err_code = clEnqueueReadBuffer(queue, pr->packed, CL_TRUE, 0, pr->byte_cnt, out, 0, NULL, NULL);
+	if(e->err_code)
+		e->detail = "clEnqueueReadBuffer";
+}
+
+void releasePackedReadback(PackedReadback* pr)
+{
+	if(pr->kernel)
+		clReleaseKernel(pr->kernel);
+	if(pr->packed)
+		clReleaseMemObject(pr->packed);
+	*pr = (PackedReadback){0};
+}
+
+// converts format of data to char array compatible read, host side fallback for when createPackedReadback() can't be used,
 // data must point to a 32-bit aligned array. if it was malloc'd, it is aligned
 // returns channel count since it's often needed after this and is already called here
 uint8_t readImageAsCharArr(char* data, StagedQ const* staged, uint16_t idx)
@@ -593,8 +1428,10 @@ void freeQStagingArrays(QStaging* staging)
 	}
 	free(staging->kern_stg);
 	free(staging->img_arg_stg);
+	free(staging->range_calcs);	// arg_size_calcs shares this allocation
 	//TODO: if you add arg_names copying the names would need to be freed here
 	free(staging->kprog_names);
+	free(staging->stage_mask);
 }
 
 void freeStagedQArrays(StagedQ* staged)
@@ -605,14 +1442,23 @@ void freeStagedQArrays(StagedQ* staged)
 	cl_uint err;
 	for(int i = 0; i < staged->img_arg_cnt; ++i)
 	{
+		if(!staged->img_args[i])	// instantiation failed before reaching it
+			continue;
 		err = clReleaseMemObject(staged->img_args[i]);
 		handleClError(err, "clReleaseMemObject");
 	}
 
 	for(int i = 0; i < staged->stage_cnt; ++i)
 	{
+		if(!staged->kernels[i])
+			continue;
 		err = clReleaseKernel(staged->kernels[i]);
 		handleClError(err, "clReleaseKernel");
 	}
 	free(staged->img_args);
+	free(staged->arg_host_flags);
+	free(staged->readback_periods);
+	free(staged->stage_host_flags);
+	free(staged->sample_periods);
+	free(staged->count_args);
 }
\ No newline at end of file
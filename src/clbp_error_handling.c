@@ -9,6 +9,12 @@ static const char* clbp_error_strings[] = {
 	"\nERROR: Couldn't find file \"%s\".\n",
 	"\nERROR: Invalid RangeMode at index %i (+: arg index, -: kernel index)\n",
 	"\nERROR: Invalid RangeMode at index %i (+: arg index, -: kernel index)\n",
+	"\nERROR: Frame \"%s\" doesn't match the dimensions of the first frame.\n",
+	"\nERROR: Couldn't read frames from \"%s\", unsupported or malformed header, or missing dimensions for raw Y8.\n",
+	"\nERROR: Configuration doesn't fit in device memory, %s.\n",
+	"\nERROR: Arg access cache \"%s\" doesn't match the manifest, rerun a validation build to regenerate it.\n",
+	"\nERROR: Kernel bundle \"%s\" is malformed, from an incompatible version, or its kernel sources or build args have changed.\n",
+	"\nERROR: Kernel bundle \"%s\" was built for a different device, rebuild it with compile_kernels on this one.\n",
 
 	"\nTOML ERROR: %s\n",
 	MANIFEST_ERROR"Stages array must be a table array with at least one item.\n",
@@ -22,6 +28,10 @@ static const char* clbp_error_strings[] = {
 	MANIFEST_ERROR"[Args] \"%s\" has invalid argument type.\n",
 	MANIFEST_ERROR"Referenced arg \"%s\" for size but it is not staged prior to this point.\n",
 	MANIFEST_ERROR"mode specifier \"%s\" is not a recognized range calculation mode.\n",
+	MANIFEST_ERROR"[Args] \"%s\" readback must be a positive frame period or 'on_demand'.\n",
+	MANIFEST_ERROR"Profile \"%s\" needs an outputs string array in [Profiles] and at least one stage writing to them.\n",
+	MANIFEST_ERROR"Sample at entry %i of stages array must be a positive frame period or 'on_demand'.\n",
+	MANIFEST_ERROR"count_arg \"%s\" must be a BUFFER with channel_type 'uint32' and 1 channel staged before the stage using it.\n",
 };
 
 // if err_code not CLBP_OK, prints the error message with details injected and
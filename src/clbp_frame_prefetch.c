@@ -0,0 +1,294 @@
+#include "clbp_frame_prefetch.h"
+#include "cl_boilerplate.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#define STBI_DECLARATIONS_ONLY
+#include "stb_image.h"
+
+static int compareStrings(void const* a, void const* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// appends str to the list, growing it as needed, returns 0 on allocation failure
+static char appendString(char*** list, uint32_t* cnt, uint32_t* cap, char* str)
+{
+	if(!str)
+		return 0;
+	if(*cnt == *cap)
+	{
+		uint32_t new_cap = *cap ? *cap * 2 : 64;
+		char** new_list = realloc(*list, new_cap * sizeof(char*));
+		if(!new_list)
+		{
+			free(str);
+			return 0;
+		}
+		*list = new_list;
+		*cap = new_cap;
+	}
+	(*list)[(*cnt)++] = str;
+	return 1;
+}
+
+static char* joinPath(char const* dir, char const* name)
+{
+	size_t dir_len = strlen(dir);
+	char* path = malloc(dir_len + strlen(name) + 2);
+	if(path)
+		sprintf(path, (dir_len && dir[dir_len-1] != '/') ? "%s/%s" : "%s%s", dir, name);
+	return path;
+}
+
+char** listInputFiles(char const* path, uint32_t* cnt, clbp_Error* e)
+{
+	char** list = NULL;
+	uint32_t cap = 0;
+	*cnt = 0;
+
+	struct stat info;
+	if(stat(path, &info))
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)path};
+		return NULL;
+	}
+
+	size_t path_len = strlen(path);
+	if(S_ISDIR(info.st_mode))
+	{
+		DIR* dir = opendir(path);
+		if(!dir)
+		{
+			*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)path};
+			return NULL;
+		}
+		for(struct dirent* entry; (entry = readdir(dir));)
+		{
+			if(entry->d_name[0] == '.')	// skips hidden files as well as . and ..
+				continue;
+			if(!appendString(&list, cnt, &cap, joinPath(path, entry->d_name)))
+			{
+				closedir(dir);
+				goto out_of_memory;
+			}
+		}
+		closedir(dir);
+		// readdir order is unspecified, frame sequences are expected to be numbered
+		if(list)
+			qsort(list, *cnt, sizeof(char*), compareStrings);
+	}
+	else if(path_len > 4 && !strcmp(path + path_len - 4, ".txt"))
+	{
+		FILE* list_file = fopen(path, "r");
+		if(!list_file)
+		{
+			*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)path};
+			return NULL;
+		}
+		char line[4096];
+		while(fgets(line, sizeof(line), list_file))
+		{
+			line[strcspn(line, "\r\n")] = '\0';
+			if(!line[0])
+				continue;
+			if(!appendString(&list, cnt, &cap, strdup(line)))
+			{
+				fclose(list_file);
+				goto out_of_memory;
+			}
+		}
+		fclose(list_file);
+	}
+	else if(!appendString(&list, cnt, &cap, strdup(path)))
+		goto out_of_memory;
+
+	if(!*cnt)
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)path};
+	return list;
+
+out_of_memory:
+	freeInputFileList(list, *cnt);
+	*cnt = 0;
+	*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "input file list"};
+	return NULL;
+}
+
+void freeInputFileList(char** list, uint32_t cnt)
+{
+	if(!list)
+		return;
+	for(uint32_t i = 0; i < cnt; ++i)
+		free(list[i]);
+	free(list);
+}
+
+// runs on a pool worker, the slot is exclusively owned by it until the state changes
+static void decodeFrameJob(void* arg)
+{
+	FrameSlot* slot = arg;
+	FramePrefetcher* fp = slot->owner;
+	int x, y, ch;
+	enum frameSlotState state = CLBP_FRAME_READY;
+	cl_int err_code = CLBP_OK;
+
+	uint8_t* decoded = stbi_load(fp->fnames[slot->frame_idx], &x, &y, &ch, fp->channels);
+	if(!decoded)
+	{
+		state = CLBP_FRAME_FAILED;
+		err_code = CLBP_FILE_NOT_FOUND;
+	}
+	else if(x != fp->width || y != fp->height)
+	{
+		state = CLBP_FRAME_FAILED;
+		err_code = CLBP_INVALID_FRAME_SIZE;
+	}
+	else
+		memcpy(slot->data, decoded, fp->frame_bytes);
+	stbi_image_free(decoded);
+
+	pthread_mutex_lock(&fp->lock);
+	slot->state = state;
+	slot->err_code = err_code;
+	pthread_cond_broadcast(&fp->slot_changed);
+	pthread_mutex_unlock(&fp->lock);
+}
+
+static void queueDecode(FramePrefetcher* fp, FrameSlot* slot, uint32_t frame_idx)
+{
+	pthread_mutex_lock(&fp->lock);
+	slot->frame_idx = frame_idx;
+	slot->state = CLBP_FRAME_DECODING;
+	pthread_mutex_unlock(&fp->lock);
+	submitJob(fp->pool, decodeFrameJob, slot);
+}
+
+void createFramePrefetcher(FramePrefetcher* fp, ThreadPool* pool, char const** fnames, uint32_t frame_cnt, uint8_t slot_cnt, uint8_t channels, clbp_Error* e)
+{
+	// no point in having more slots than frames
+	if(slot_cnt > frame_cnt)
+		slot_cnt = frame_cnt;
+	if(!slot_cnt)
+		slot_cnt = 1;
+
+	*fp = (FramePrefetcher){
+		.pool = pool,
+		.fnames = fnames,
+		.frame_cnt = frame_cnt,
+		.slot_cnt = slot_cnt,
+		.channels = channels
+	};
+	pthread_mutex_init(&fp->lock, NULL);
+	pthread_cond_init(&fp->slot_changed, NULL);
+
+	if(!frame_cnt)
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = "\nNo input frames"};
+		return;
+	}
+
+	// first frame is decoded up front since its size is needed to size the ring and the rest of the pipeline
+	int ch;
+	uint8_t* first = stbi_load(fnames[0], &fp->width, &fp->height, &ch, channels);
+	if(!first)
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)fnames[0]};
+		return;
+	}
+	fp->frame_bytes = (size_t)fp->width * fp->height * channels;
+	printf("prefetching %u frame(s), %i*%i image with %i channel(s), using %i channel(s), %u slot(s).\n",
+		frame_cnt, fp->width, fp->height, ch, channels, slot_cnt);
+
+	fp->slots = calloc(slot_cnt, sizeof(FrameSlot));
+	if(!fp->slots)
+	{
+		stbi_image_free(first);
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "frame prefetch slots"};
+		return;
+	}
+
+	// frames are copied into the mapped input image by writeInputImage() so plain host memory is all the ring needs
+	for(uint8_t i = 0; i < slot_cnt; ++i)
+	{
+		FrameSlot* slot = &fp->slots[i];
+		slot->owner = fp;
+		slot->data = malloc(fp->frame_bytes);
+		if(!slot->data)
+		{
+			stbi_image_free(first);
+			destroyFramePrefetcher(fp);
+			*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "frame prefetch buffers"};
+			return;
+		}
+	}
+
+	memcpy(fp->slots[0].data, first, fp->frame_bytes);
+	stbi_image_free(first);
+	fp->slots[0].state = CLBP_FRAME_READY;
+
+	for(uint8_t i = 1; i < slot_cnt; ++i)
+		queueDecode(fp, &fp->slots[i], i);
+}
+
+FrameSlot* acquireFrame(FramePrefetcher* fp, clbp_Error* e)
+{
+	if(fp->next_frame >= fp->frame_cnt)
+		return NULL;
+
+	FrameSlot* slot = &fp->slots[fp->next_frame % fp->slot_cnt];
+	pthread_mutex_lock(&fp->lock);
+	while(slot->state == CLBP_FRAME_DECODING)
+		pthread_cond_wait(&fp->slot_changed, &fp->lock);
+	pthread_mutex_unlock(&fp->lock);
+
+	++fp->next_frame;
+	if(slot->state == CLBP_FRAME_FAILED)
+	{
+		*e = (clbp_Error){.err_code = slot->err_code, .detail = (char*)fp->fnames[slot->frame_idx]};
+		slot->state = CLBP_FRAME_ACQUIRED;
+		releaseFrame(slot);
+		return NULL;
+	}
+
+	slot->state = CLBP_FRAME_ACQUIRED;
+	return slot;
+}
+
+void releaseFrame(FrameSlot* slot)
+{
+	FramePrefetcher* fp = slot->owner;
+	uint32_t next_idx = slot->frame_idx + fp->slot_cnt;
+	if(next_idx < fp->frame_cnt)
+	{
+		queueDecode(fp, slot, next_idx);
+		return;
+	}
+
+	pthread_mutex_lock(&fp->lock);
+	slot->state = CLBP_FRAME_EMPTY;
+	pthread_mutex_unlock(&fp->lock);
+}
+
+void destroyFramePrefetcher(FramePrefetcher* fp)
+{
+	if(fp->slots)
+	{
+		// workers still hold pointers into the ring until their decode finishes
+		pthread_mutex_lock(&fp->lock);
+		for(uint8_t i = 0; i < fp->slot_cnt; ++i)
+		{
+			while(fp->slots[i].state == CLBP_FRAME_DECODING)
+				pthread_cond_wait(&fp->slot_changed, &fp->lock);
+		}
+		pthread_mutex_unlock(&fp->lock);
+
+		for(uint8_t i = 0; i < fp->slot_cnt; ++i)
+			free(fp->slots[i].data);
+		free(fp->slots);
+	}
+
+	pthread_mutex_destroy(&fp->lock);
+	pthread_cond_destroy(&fp->slot_changed);
+	*fp = (FramePrefetcher){0};
+}
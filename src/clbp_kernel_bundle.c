@@ -0,0 +1,241 @@
+#include "clbp_kernel_bundle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cl_error_handlers.h"
+#include "clbp_frame_prefetch.h"
+
+#define FNV_OFFSET_BASIS	0xcbf29ce484222325ull
+#define FNV_PRIME	0x100000001b3ull
+
+static uint64_t hashBytes(uint64_t hash, void const* data, size_t len)
+{
+	uint8_t const* c = data;
+	for(size_t i = 0; i < len; ++i)
+	{
+		hash ^= c[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+// the terminator is hashed too so that moving characters between adjacent strings changes the hash
+static uint64_t hashString(uint64_t hash, char const* str)
+{
+	return hashBytes(hash, str, strlen(str) + 1);
+}
+
+// the length goes in after the contents so that moving bytes between adjacent files changes the hash
+static uint64_t hashFile(uint64_t hash, char const* fname)
+{
+	uint64_t len = 0;
+	FILE* file = fopen(fname, "rb");
+	if(file)
+	{
+		unsigned char buf[4096];
+		size_t read_cnt;
+		while((read_cnt = fread(buf, 1, sizeof(buf), file)))
+		{
+			hash = hashBytes(hash, buf, read_cnt);
+			len += read_cnt;
+		}
+		fclose(file);
+	}
+	else
+		len = UINT64_MAX;
+	return hashBytes(hash, &len, sizeof(len));
+}
+
+// includes are found by the compiler so there's no telling which ones a program uses without preprocessing it,
+// instead every file in an include directory is hashed, sorted so directory order doesn't matter
+static uint64_t hashIncludeDir(uint64_t hash, char const* dir, size_t dir_len)
+{
+	char path[FILENAME_MAX];
+	snprintf(path, sizeof(path), "%.*s", (int)dir_len, dir);
+	clbp_Error e = {.err_code = CLBP_OK};
+	uint32_t cnt;
+	char** fnames = listInputFiles(path, &cnt, &e);
+	if(e.err_code)	// missing include directories are ignored by the compiler too
+		return hash;
+	for(uint32_t i = 0; i < cnt; ++i)
+	{
+		char const* name = strrchr(fnames[i], '/');
+		hash = hashString(hash, name ? name + 1 : fnames[i]);
+		hash = hashFile(hash, fnames[i]);
+	}
+	freeInputFileList(fnames, cnt);
+	return hash;
+}
+
+uint64_t hashKernelBuild(QStaging const* staging, char const* src_dir, char const* build_args)
+{
+	uint64_t hash = hashString(FNV_OFFSET_BASIS, build_args ? build_args : "");
+	char path[FILENAME_MAX];
+	for(int i = 0; i < staging->kernel_cnt; ++i)
+	{
+		hash = hashString(hash, staging->kprog_names[i]);
+		snprintf(path, sizeof(path), "%s%s.cl", src_dir, staging->kprog_names[i]);
+		hash = hashFile(hash, path);
+	}
+
+	// both "-I<dir>" and "-I <dir>" are accepted by the compiler
+	char const* c = build_args ? build_args : "";
+	while(*(c += strspn(c, " \t")))
+	{
+		size_t len = strcspn(c, " \t");
+		if(!strncmp(c, "-I", 2))
+		{
+			if(len == 2)
+			{
+				c += len;
+				c += strspn(c, " \t");
+				len = strcspn(c, " \t");
+				hash = hashIncludeDir(hash, c, len);
+			}
+			else
+				hash = hashIncludeDir(hash, c + 2, len - 2);
+		}
+		c += len;
+	}
+	return hash;
+}
+
+static void writeKernelBundle(KernelBundleHeader* header, void const* payload, QStaging const* staging, char const* src_dir, char const* build_args, char const* fname, clbp_Error* e)
+{
+	memcpy(header->magic, CLBP_BUNDLE_MAGIC, sizeof(CLBP_BUNDLE_MAGIC));
+	header->version = CLBP_BUNDLE_VERSION;
+	header->build_hash = hashKernelBuild(staging, src_dir, build_args);
+	if(build_args)
+		strncpy(header->build_args, build_args, sizeof(header->build_args) - 1);
+
+	FILE* file = fopen(fname, "wb");
+	if(!file)
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)fname};
+		return;
+	}
+	char is_ok = fwrite(header, sizeof(*header), 1, file) == 1
+		&& fwrite(payload, 1, header->payload_size, file) == header->payload_size;
+	if(fclose(file) || !is_ok)
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)fname};
+}
+
+void saveKernelBundle(cl_program prog, cl_device_id device, QStaging const* staging, char const* src_dir, char const* build_args, char const* fname, clbp_Error* e)
+{
+	KernelBundleHeader header = {.kind = CLBP_BUNDLE_BINARY};
+	e->err_code = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(header.device_name) - 1, header.device_name, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetDeviceInfo->CL_DEVICE_NAME";
+		return;
+	}
+
+	// the program was only built for the one device so there's only one binary
+	size_t binary_size;
+	e->err_code = clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(binary_size), &binary_size, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetProgramInfo->CL_PROGRAM_BINARY_SIZES";
+		return;
+	}
+	unsigned char* binary = malloc(binary_size);
+	if(!binary)
+	{
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "kernel binary"};
+		return;
+	}
+	e->err_code = clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(binary), &binary, NULL);
+	if(e->err_code)
+	{
+		free(binary);
+		e->detail = "clGetProgramInfo->CL_PROGRAM_BINARIES";
+		return;
+	}
+
+	header.payload_size = binary_size;
+	writeKernelBundle(&header, binary, staging, src_dir, build_args, fname, e);
+	free(binary);
+}
+
+cl_program loadKernelBundle(cl_context context, cl_device_id device, QStaging const* staging, char const* src_dir, char const* build_args, char const* fname, clbp_Error* e)
+{
+	FILE* file = fopen(fname, "rb");
+	if(!file)
+	{
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)fname};
+		return NULL;
+	}
+
+	KernelBundleHeader header;
+	unsigned char* payload = NULL;
+	char is_valid = fread(&header, sizeof(header), 1, file) == 1
+		&& !memcmp(header.magic, CLBP_BUNDLE_MAGIC, sizeof(CLBP_BUNDLE_MAGIC))
+		&& header.version == CLBP_BUNDLE_VERSION
+		&& header.build_hash == hashKernelBuild(staging, src_dir, build_args)
+		&& header.payload_size;
+	if(is_valid)
+	{
+		payload = malloc(header.payload_size);
+		is_valid = payload && fread(payload, 1, header.payload_size, file) == header.payload_size;
+	}
+	fclose(file);
+	if(!is_valid)
+	{
+		free(payload);
+		*e = (clbp_Error){.err_code = CLBP_INVALID_KERNEL_BUNDLE, .detail = (char*)fname};
+		return NULL;
+	}
+	header.device_name[sizeof(header.device_name) - 1] = '\0';
+	header.build_args[sizeof(header.build_args) - 1] = '\0';
+
+	cl_program prog = NULL;
+	if(header.kind == CLBP_BUNDLE_BINARY)
+	{
+		char device_name[sizeof(header.device_name)] = {0};
+		e->err_code = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+		if(e->err_code)
+		{
+			free(payload);
+			e->detail = "clGetDeviceInfo->CL_DEVICE_NAME";
+			return NULL;
+		}
+		// a binary for another device either fails to load or worse, loads and runs code compiled for something else
+		if(strcmp(device_name, header.device_name))
+		{
+			free(payload);
+			fprintf(stderr, "\nkernel bundle was built for \"%s\" but is being loaded on \"%s\".", header.device_name, device_name);
+			*e = (clbp_Error){.err_code = CLBP_KERNEL_BUNDLE_WRONG_DEVICE, .detail = (char*)fname};
+			return NULL;
+		}
+
+		size_t size = header.payload_size;
+		cl_int binary_status;
+		prog = clCreateProgramWithBinary(context, 1, &device, &size, (unsigned char const**)&payload, &binary_status, &e->err_code);
+		if(!e->err_code)
+			e->err_code = binary_status;
+		if(e->err_code)
+			e->detail = "clCreateProgramWithBinary";
+	}
+	else
+		*e = (clbp_Error){.err_code = CLBP_INVALID_KERNEL_BUNDLE, .detail = (char*)fname};
+	free(payload);
+	if(e->err_code)
+	{
+		if(prog)
+			clReleaseProgram(prog);
+		return NULL;
+	}
+
+	// binaries are already executables so this only finalizes them for the device
+	printf("Loading kernel bundle %s (built with \"%s\")\n", fname, header.build_args);
+	e->err_code = clBuildProgram(prog, 1, &device, header.build_args, NULL, NULL);
+	if(e->err_code)
+	{
+		if(e->err_code == CL_BUILD_PROGRAM_FAILURE)
+			handleClBuildProgram(e->err_code, prog, device);
+		clReleaseProgram(prog);
+		e->detail = "clBuildProgram";
+		return NULL;
+	}
+	return prog;
+}
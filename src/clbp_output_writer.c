@@ -0,0 +1,157 @@
+#include "clbp_output_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+// the only file that compiles the stb_image_write implementation, others define STBIW_DECLARATIONS_ONLY
+#include "stb_image_write.h"
+
+char const* outputFormatNames[CLBP_INVALID_OUT_FORMAT+1] = {
+	"png",
+	"pnm",
+	"raw",
+	NULL
+};
+
+enum outputFormat parseOutputFormat(char const* str)
+{
+	enum outputFormat format = 0;
+	while(format < CLBP_INVALID_OUT_FORMAT && strcmp(str, outputFormatNames[format]))
+		++format;
+	return format;
+}
+
+// writes 8-bit binary netpbm, PGM and PPM cover gray and RGB but anything else needs the PAM header
+static char writePnm(char const* fname, OutputSlot const* slot)
+{
+	FILE* file = fopen(fname, "wb");
+	if(!file)
+		return 0;
+
+	uint8_t ch_cnt = slot->channel_cnt;
+	if(ch_cnt == 1 || ch_cnt == 3)
+		fprintf(file, "P%c\n%i %i\n255\n", ch_cnt == 1 ? '5' : '6', slot->width, slot->height);
+	else
+		fprintf(file, "P7\nWIDTH %i\nHEIGHT %i\nDEPTH %u\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+			slot->width, slot->height, ch_cnt, ch_cnt == 2 ? "GRAYSCALE_ALPHA" : "RGB_ALPHA");
+
+	size_t byte_cnt = (size_t)slot->width * slot->height * ch_cnt;
+	char is_ok = fwrite(slot->data, 1, byte_cnt, file) == byte_cnt;
+	return !fclose(file) && is_ok;
+}
+
+static char writeRaw(char const* fname, OutputSlot const* slot)
+{
+	FILE* file = fopen(fname, "wb");
+	if(!file)
+		return 0;
+
+	size_t byte_cnt = (size_t)slot->width * slot->height * slot->channel_cnt;
+	char is_ok = fwrite(slot->data, 1, byte_cnt, file) == byte_cnt;
+	return !fclose(file) && is_ok;
+}
+
+static void writeJob(void* arg)
+{
+	OutputSlot* slot = arg;
+	OutputWriter* ow = slot->owner;
+	char is_ok;
+	switch(ow->format)
+	{
+	case CLBP_OUT_PNM:
+		is_ok = writePnm(slot->fname, slot);
+		break;
+	case CLBP_OUT_RAW:
+		is_ok = writeRaw(slot->fname, slot);
+		break;
+	default:
+		is_ok = stbi_write_png(slot->fname, slot->width, slot->height, slot->channel_cnt, slot->data, slot->width * slot->channel_cnt);
+	}
+	if(!is_ok)
+		fprintf(stderr, "\nWARNING: couldn't write %s", slot->fname);
+
+	pthread_mutex_lock(&ow->lock);
+	ow->fail_cnt += !is_ok;
+	slot->is_queued = 0;
+	pthread_cond_broadcast(&ow->slot_freed);
+	pthread_mutex_unlock(&ow->lock);
+}
+
+void createOutputWriter(OutputWriter* ow, uint8_t slot_cnt, size_t buf_bytes, enum outputFormat format, clbp_Error* e)
+{
+	*ow = (OutputWriter){.slot_cnt = slot_cnt, .format = format, .buf_bytes = buf_bytes};
+	ow->slots = calloc(slot_cnt, sizeof(OutputSlot));
+	if(!ow->slots)
+	{
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "output slots"};
+		return;
+	}
+	pthread_mutex_init(&ow->lock, NULL);
+	pthread_cond_init(&ow->slot_freed, NULL);
+
+	for(uint8_t i = 0; i < slot_cnt; ++i)
+	{
+		// malloc'd so it satisfies the alignment readImageAsCharArr() needs
+		ow->slots[i] = (OutputSlot){.owner = ow, .data = malloc(buf_bytes)};
+		if(!ow->slots[i].data)
+		{
+			destroyOutputWriter(ow);
+			*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "output slot buffer"};
+			return;
+		}
+	}
+
+	if(createThreadPool(&ow->pool, 1, slot_cnt))
+	{
+		ow->pool = (ThreadPool){0};	// nothing left running to join
+		destroyOutputWriter(ow);
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "output writer thread"};
+	}
+}
+
+OutputSlot* acquireOutputSlot(OutputWriter* ow)
+{
+	OutputSlot* slot = &ow->slots[ow->next_slot];
+	ow->next_slot = (ow->next_slot + 1) % ow->slot_cnt;
+
+	pthread_mutex_lock(&ow->lock);
+	while(slot->is_queued)
+		pthread_cond_wait(&ow->slot_freed, &ow->lock);
+	pthread_mutex_unlock(&ow->lock);
+	return slot;
+}
+
+void submitOutput(OutputSlot* slot, char const* base_name, int width, int height, uint8_t channel_cnt)
+{
+	OutputWriter* ow = slot->owner;
+	char const* ext = outputFormatNames[ow->format];
+	if(ow->format == CLBP_OUT_PNM)
+		ext = (channel_cnt == 1) ? "pgm" : (channel_cnt == 3) ? "ppm" : "pam";
+	snprintf(slot->fname, sizeof(slot->fname), "%s.%s", base_name, ext);
+	slot->width = width;
+	slot->height = height;
+	slot->channel_cnt = channel_cnt;
+
+	// the worker only clears this under the lock after it's done with the slot
+	slot->is_queued = 1;
+	submitJob(&ow->pool, writeJob, slot);
+}
+
+uint32_t destroyOutputWriter(OutputWriter* ow)
+{
+	if(!ow->slots)
+		return 0;
+
+	// joins the writer thread, anything queued gets written first
+	if(ow->pool.threads)
+		destroyThreadPool(&ow->pool);
+
+	for(uint8_t i = 0; i < ow->slot_cnt; ++i)
+		free(ow->slots[i].data);
+	free(ow->slots);
+	pthread_mutex_destroy(&ow->lock);
+	pthread_cond_destroy(&ow->slot_freed);
+
+	uint32_t fail_cnt = ow->fail_cnt;
+	*ow = (OutputWriter){0};
+	return fail_cnt;
+}
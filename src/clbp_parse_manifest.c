@@ -3,6 +3,9 @@
 #include "cl_boilerplate.h"
 #include "clbp_utils.h"
 #include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
 
 clbp_Error parseRangeData(QStaging* staging, RangeData* ret, toml_table_t* size_tbl)
 {
@@ -63,8 +66,38 @@ clbp_Error validateNstoreArgConfig(QStaging* staging, toml_table_t* args, char*
 	ArgStaging* new_arg = &staging->img_arg_stg[*arg_cnt];
 
 	// parse if arg was manually set to host readable, defaults to false if not specified
+	// host readable args are outputs that are only read back on demand unless they also have a readback period
 	toml_value_t is_host_readable = toml_table_bool(arg_conf, "is_host_readable");
 	new_arg->flags = is_host_readable.u.b ? CL_MEM_HOST_READ_ONLY : 0;	// toml not ok should default to false for bool I think
+	new_arg->readback_period = 0;
+
+	// readback = N reads the output back every Nth frame, readback = 'on_demand' only when requested
+	toml_value_t readback = toml_table_int(arg_conf, "readback");
+	if(readback.ok)
+	{
+		if(readback.u.i <= 0 || readback.u.i > UINT16_MAX)
+			return (clbp_Error){.err_code = CLBP_MF_INVALID_READBACK, .detail = arg_name};
+		new_arg->readback_period = readback.u.i;
+		new_arg->flags = CL_MEM_HOST_READ_ONLY;
+	}
+	else
+	{
+		readback = toml_table_string(arg_conf, "readback");
+		if(readback.ok)
+		{
+			char is_on_demand = !strcmp(readback.u.s, "on_demand");
+			free(readback.u.s);
+			if(!is_on_demand)
+				return (clbp_Error){.err_code = CLBP_MF_INVALID_READBACK, .detail = arg_name};
+			new_arg->flags = CL_MEM_HOST_READ_ONLY;
+		}
+	}
+
+	// parse if arg needs to be zeroed before every run, ie. atomic counters, defaults to false if not specified
+	toml_value_t is_cleared = toml_table_bool(arg_conf, "is_cleared");
+	new_arg->host_flags = is_cleared.u.b ? CLBP_AHF_CLEAR : 0;
+	if(new_arg->flags & CL_MEM_HOST_READ_ONLY)
+		new_arg->host_flags |= CLBP_AHF_OUTPUT;
 
 	toml_value_t ch_type_toml = toml_table_string(arg_conf, "channel_type");
 	enum clChannelType ch_type = CLBP_INVALID_CHANNEL_TYPE;
@@ -191,8 +224,8 @@ void allocQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clbp_E
 			return;
 		}
 		staging->arg_names[i] = name.u.s;
-		// set the flag for the hardcoded arg to copy the contents of host memory to device memory
-		staging->img_arg_stg[i].flags = CL_MEM_COPY_HOST_PTR;
+		// set the flags for the hardcoded arg to be host writable device memory, filled in by writeInputImage()
+		staging->img_arg_stg[i].flags = CLBP_INPUT_MEM_FLAGS;
 	}
 	//TODO: check if it max_defined_args is still needed to be copied here or if this can be set to the hardcoded args count
 	//technically this is an upper limit but it can be stored here temporarily until we get the real count
@@ -201,6 +234,171 @@ void allocQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clbp_E
 	return;
 }
 
+// finds the parameter list of the kernel definition called name, returns a pointer just past its '(' or NULL if not found
+static char const* findKernelParams(char const* src, char const* name)
+{
+	size_t len = strlen(name);
+	for(char const* p = strstr(src, name); p; p = strstr(p + 1, name))
+	{
+		char const* params = p + len;
+		while(isspace(*params))
+			++params;
+		if(*params != '(')
+			continue;
+		// definitions are the only place the name follows the return type
+		char const* ret_type = p;
+		while(ret_type > src && isspace(ret_type[-1]))
+			--ret_type;
+		if(ret_type - src >= 4 && !strncmp(ret_type - 4, "void", 4))
+			return params + 1;
+	}
+	return NULL;
+}
+
+// scans the kernel's signature for the args it can write to, write_only or read_write images and global pointers to non-const,
+// so liveness can be worked out before anything gets compiled, bit j is set if arg j may be written to
+// returns all bits set if the signature couldn't be found so the stage is treated as writing everything
+static uint64_t scanKernelArgWrites(char const* src, char const* name)
+{
+	char const* c = findKernelParams(src, name);
+	if(!c)
+		return ~0ull;
+
+	uint64_t writes = 0;
+	char param[256];
+	int param_len = 0;
+	int arg_idx = 0;
+	for(; *c; ++c)
+	{
+		if(c[0] == '/' && c[1] == '/')
+		{
+			while(c[1] && c[1] != '\n')
+				++c;
+			continue;
+		}
+		if(c[0] == '/' && c[1] == '*')
+		{
+			for(c += 2; c[0] && !(c[0] == '*' && c[1] == '/'); ++c);
+			if(!*c)
+				break;
+			++c;
+			continue;
+		}
+		if(*c != ',' && *c != ')')
+		{
+			if(param_len < (int)sizeof(param) - 1)
+				param[param_len++] = *c;
+			continue;
+		}
+
+		param[param_len] = '\0';
+		char is_written = strstr(param, "write_only") || strstr(param, "read_write")
+			|| (strchr(param, '*') && !strstr(param, "const") && !strstr(param, "local"));
+		if(is_written || arg_idx >= 64)
+			writes |= 1ull << (arg_idx < 64 ? arg_idx : 63);
+		++arg_idx;
+		param_len = 0;
+		if(*c == ')')
+			break;
+	}
+	return writes;
+}
+
+// the list takes ownership of name if it wasn't already in it
+static void addNeededName(char** needed, int max_names, char* name)
+{
+	int idx = addUniqueString(needed, max_names, name);
+	if(idx < 0 || needed[idx] != name)
+		free(name);
+}
+
+// picks which stages of the manifest get staged by populateQStagingArrays(), only stages that write to one of the profile's outputs
+// or to something a later kept stage uses are kept, profile names an entry of [Profiles] or NULL for the manifest's Profile key,
+// if neither is given every stage is kept, must be run between allocQStagingArrays() and populateQStagingArrays()
+//NOTE: args are matched by name so a stage that rewrites an arg keeps the earlier writers of it too
+void selectStageProfile(const toml_table_t* root_tbl, char const* profile, char const* src_dir, QStaging* staging, clbp_Error* e)
+{
+	assert(root_tbl && src_dir && staging && e);
+	// copied out so the key can be freed before anything returns
+	toml_value_t profile_key = toml_table_string(root_tbl, "Profile");
+	static char detail[64];
+	snprintf(detail, sizeof(detail), "%s", profile ? profile : profile_key.u.s);
+	if(profile_key.ok)
+		free(profile_key.u.s);
+	if(!detail[0])
+		return;
+	toml_table_t* profiles = toml_table_table(root_tbl, "Profiles");
+	toml_table_t* curr_profile = profiles ? toml_table_table(profiles, detail) : NULL;
+	toml_array_t* outputs = curr_profile ? toml_table_array(curr_profile, "outputs") : NULL;
+	if(!outputs || outputs->kind != 'v' || outputs->type != 's')
+	{
+		*e = (clbp_Error){.err_code = CLBP_MF_INVALID_PROFILE, .detail = detail};
+		return;
+	}
+
+	// every name in the manifest fits since it's at most one per stage arg plus the outputs
+	toml_array_t* stage_list = toml_table_array(root_tbl, "Stages");
+	int max_names = outputs->nitem;
+	for(int i = 0; i < stage_list->nitem; ++i)
+	{
+		toml_array_t* stage_args = toml_table_array(toml_array_table(stage_list, i), "args");
+		max_names += stage_args ? stage_args->nitem : 0;
+	}
+	char** needed = calloc(max_names + 1, sizeof(char*));
+	staging->stage_mask = calloc(stage_list->nitem, sizeof(uint8_t));
+	if(!needed || !staging->stage_mask)
+	{
+		free(needed);
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "stage profile"};
+		return;
+	}
+	for(int i = 0; i < outputs->nitem; ++i)
+		addNeededName(needed, max_names, toml_array_string(outputs, i).u.s);
+
+	// walk backwards so every kept stage has already marked what it needs by the time its producers are checked
+	int live_cnt = 0;
+	char fpath[1024];
+	for(int i = stage_list->nitem - 1; i >= 0 && !e->err_code; --i)
+	{
+		toml_table_t* stage = toml_array_table(stage_list, i);
+		toml_array_t* stage_args = toml_table_array(stage, "args");
+		toml_value_t name = toml_table_string(stage, "name");
+		if(!name.ok || !stage_args || stage_args->kind != 'v' || stage_args->type != 's')
+		{	// left for populateQStagingArrays() to report
+			staging->stage_mask[i] = 1;
+			if(name.ok)
+				free(name.u.s);
+			continue;
+		}
+
+		snprintf(fpath, sizeof(fpath)-1, "%s%s.cl", src_dir, name.u.s);
+		char* src = readFileToCstring(fpath, e);
+		uint64_t writes = src ? scanKernelArgWrites(src, name.u.s) : 0;
+		free(src);
+		free(name.u.s);
+		for(int j = 0; j < stage_args->nitem && !staging->stage_mask[i]; ++j)
+		{
+			toml_value_t arg_name = toml_array_string(stage_args, j);
+			if((writes >> (j < 64 ? j : 63) & 1) && getStringIndex((char const**)needed, arg_name.u.s) >= 0)
+				staging->stage_mask[i] = 1;
+			free(arg_name.u.s);
+		}
+		if(!staging->stage_mask[i])
+			continue;
+
+		++live_cnt;
+		for(int j = 0; j < stage_args->nitem; ++j)
+			addNeededName(needed, max_names, toml_array_string(stage_args, j).u.s);
+	}
+	for(int i = 0; needed[i]; ++i)
+		free(needed[i]);
+	free(needed);
+	if(!e->err_code && !live_cnt)
+		*e = (clbp_Error){.err_code = CLBP_MF_INVALID_PROFILE, .detail = detail};
+	if(!e->err_code)
+		printf("Profile \"%s\" keeps %i of %i stages.\n", detail, live_cnt, stage_list->nitem);
+}
+
 // validate MANIFEST.toml and populate program list, kernel queue staging array, and arg staging
 void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clbp_Error* e)
 {
@@ -214,9 +412,13 @@ void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clb
 	toml_table_t* args_table = toml_table_table(root_tbl, "Args");
 
 	KernStaging* curr_stage;
+	// stages skipped by selectStageProfile() leave no gaps, k counts the ones actually staged
+	int k = 0;
 	// for each stage in the stage list
 	for(int i = 0; i < staging->stage_cnt; ++i)
 	{
+		if(staging->stage_mask && !staging->stage_mask[i])
+			continue;
 		toml_table_t* stage = toml_array_table(stage_list, i);	//can't return null since we already have valid stage count
 		toml_value_t tval = toml_table_string(stage, "name");
 		if(!tval.u.s[0])	// with the change to toml-c.h, should be safe just to check for empty string
@@ -227,7 +429,7 @@ void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clb
 
 		// check if a kernel by that name already exists, if not, add it to the list of ones to build
 		// additionally set the kernel program reference index for the stage to the returned index of the match/new program name
-		curr_stage = &staging->kern_stg[i];
+		curr_stage = &staging->kern_stg[k];
 		int kern_idx = addUniqueString(staging->kprog_names, staging->stage_cnt, tval.u.s);
 		curr_stage->kernel_idx = kern_idx;
 		if(staging->kernel_cnt == kern_idx)	//check if this was a newly referenced kernel
@@ -252,6 +454,8 @@ void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clb
 		}
 
 		int stg_img_arg_cnt = toml_array_len(stage_args);
+		// re-checked against the kernel itself in inferArgAccessAndVerifyFormats(), set here so planning can use it before that
+		curr_stage->arg_cnt = stg_img_arg_cnt;
 		uint16_t* curr_arg_idx;
 		// iterate over args to find any new ones
 		for(int j = 0; j < stg_img_arg_cnt; ++j)
@@ -277,8 +481,57 @@ void populateQStagingArrays(const toml_table_t* root_tbl, QStaging* staging, clb
 		}
 
 		toml_table_t* range = toml_table_table(stage, "range");
-		*e = parseRangeData(staging, &staging->range_calcs[i], range);
+		*e = parseRangeData(staging, &staging->range_calcs[k], range);
 		if(e->err_code)
 			return;
+
+		// count_arg caps the x range to a count an earlier stage wrote, for stages launched over mostly empty compacted lists
+		curr_stage->count_idx = CLBP_NO_COUNT_ARG;
+		toml_value_t count_arg = range ? toml_table_string(range, "count_arg") : (toml_value_t){0};
+		if(count_arg.ok)
+		{
+			int count_idx = getStringIndex((char const**)staging->arg_names, count_arg.u.s);
+			ArgStaging const* count_stg = count_idx < 0 ? NULL : &staging->img_arg_stg[count_idx];
+			if(!count_stg || count_stg->type != CL_MEM_OBJECT_BUFFER || count_stg->format.image_channel_order != CL_R
+				|| count_stg->format.image_channel_data_type != CL_UNSIGNED_INT32)
+			{
+				*e = (clbp_Error){.err_code = CLBP_MF_INVALID_COUNT_ARG, .detail = count_arg.u.s};	//FIXME: leaks the name like the other arg errors
+				return;
+			}
+			free(count_arg.u.s);
+			curr_stage->count_idx = count_idx;
+			// read before every stage it caps, the device side flags follow from the stages' access to it as usual
+			staging->img_arg_stg[count_idx].flags |= CL_MEM_HOST_READ_ONLY;
+		}
+
+		// sample = N only runs the stage every Nth frame, sample = 'on_demand' only when triggered, same as readback for args
+		curr_stage->sample_period = 1;
+		toml_value_t sample = toml_table_int(stage, "sample");
+		if(sample.ok)
+		{
+			if(sample.u.i <= 0 || sample.u.i > UINT16_MAX)
+			{
+				*e = (clbp_Error){.err_code = CLBP_MF_INVALID_SAMPLE, .detail = NULL + i};
+				return;
+			}
+			curr_stage->sample_period = sample.u.i;
+		}
+		else
+		{
+			sample = toml_table_string(stage, "sample");
+			if(sample.ok)
+			{
+				char is_on_demand = !strcmp(sample.u.s, "on_demand");
+				free(sample.u.s);
+				if(!is_on_demand)
+				{
+					*e = (clbp_Error){.err_code = CLBP_MF_INVALID_SAMPLE, .detail = NULL + i};
+					return;
+				}
+				curr_stage->sample_period = 0;
+			}
+		}
+		++k;
 	}
+	staging->stage_cnt = k;
 }
@@ -0,0 +1,429 @@
+#include "clbp_pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cl_boilerplate.h"
+#include "clbp_parse_manifest.h"
+#include "clbp_kernel_bundle.h"
+#include "clbp_utils.h"
+
+// first GPU of the first platform like getPreferredDevice(), but falls back to any device and reports failures instead of printing them
+static cl_device_id pickDevice(clbp_Error* e)
+{
+	cl_platform_id platform;
+	cl_device_id device = NULL;
+	e->err_code = clGetPlatformIDs(1, &platform, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clGetPlatformIDs";
+		return NULL;
+	}
+	e->err_code = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
+	if(e->err_code == CL_DEVICE_NOT_FOUND)
+		e->err_code = clGetDeviceIDs(platform, CL_DEVICE_TYPE_ALL, 1, &device, NULL);
+	if(e->err_code)
+		e->detail = "clGetDeviceIDs";
+	return device;
+}
+
+void createPipeline(Pipeline* p, PipelineConfig const* cfg, clbp_Error* e)
+{
+	*p = (Pipeline){.ellipse_cnt_idx = -1, .ellipse_list_idx = -1};
+	p->device = cfg->device ? cfg->device : pickDevice(e);
+	if(e->err_code)
+		return;
+
+	p->context = clCreateContext(NULL, 1, &p->device, NULL, NULL, &e->err_code);
+	if(e->err_code)
+	{
+		e->detail = "clCreateContext";
+		return;
+	}
+	p->queue = clCreateCommandQueue(p->context, p->device, 0, &e->err_code);
+	if(e->err_code)
+	{
+		e->detail = "clCreateCommandQueue";
+		return;
+	}
+
+	p->manifest = parseManifestFile((char*)cfg->manifest_fname, e);
+	if(e->err_code)
+		return;
+	p->staging.input_img_cnt = 1;
+	allocQStagingArrays(p->manifest, &p->staging, e);
+	if(e->err_code)
+	{
+		p->staging = (QStaging){0};	// anything it allocated was already released
+		return;
+	}
+	selectStageProfile(p->manifest, cfg->profile, cfg->kernel_src_dir, &p->staging, e);
+	if(e->err_code)
+		return;
+	populateQStagingArrays(p->manifest, &p->staging, e);
+	if(e->err_code)
+		return;
+
+	if(cfg->kernel_bundle_fname)
+	{
+		p->program = loadKernelBundle(p->context, p->device, &p->staging, cfg->kernel_src_dir, cfg->build_args, cfg->kernel_bundle_fname, e);
+		if(e->err_code == CLBP_FILE_NOT_FOUND)	// nothing has been compiled offline yet
+			*e = (clbp_Error){.err_code = CLBP_OK};
+		if(e->err_code)
+			return;
+	}
+	if(!p->program)
+		p->program = buildKernelProgsFromSource(p->context, p->device, cfg->kernel_src_dir, &p->staging, cfg->build_args, e);
+	if(e->err_code)
+		return;
+
+	e->err_code = allocStagedQArrays(&p->staging, &p->staged);
+	if(e->err_code)
+	{
+		e->detail = "Staged queue array allocation";
+		return;
+	}
+	p->is_staged = 1;
+
+	// frames are uploaded by processFrame() so the input only needs its size and format
+	p->staging.img_arg_stg[0] = (ArgStaging){
+		.type = CL_MEM_OBJECT_IMAGE2D,
+		.flags = CLBP_INPUT_MEM_FLAGS,
+		.format = {
+			.image_channel_order = CL_R,
+			.image_channel_data_type = CL_UNORM_INT8
+		}
+	};
+	p->staging.arg_size_calcs[0] = (RangeData){.param = {cfg->width, cfg->height, 1}, .mode = CLBP_RM_EXACT, .ref_idx = 0};
+	p->width = cfg->width;
+	p->height = cfg->height;
+
+	calcRanges(&p->staging, &p->staged, e);
+	if(e->err_code)
+		return;
+	planDeviceMemory(p->device, &p->staging, &p->staged, e);
+	if(e->err_code)
+		return;
+	instantiateKernels(&p->staging, p->program, &p->staged, e);
+	if(e->err_code)
+		return;
+	if(cfg->is_release)
+	{
+		applyCachedArgAccess(&p->staging, cfg->arg_cache_fname, e);
+		if(e->err_code)
+			return;
+	}
+	else
+		inferArgAccessAndVerifyFormats(&p->staging, &p->staged, cfg->arg_cache_fname);
+	instantiateImgArgs(p->context, &p->staging, &p->staged, e);
+	if(e->err_code)
+		return;
+	setKernelArgs(&p->staging, &p->staged, e);
+	if(e->err_code)
+		return;
+
+	findEllipseListArgs((char const**)p->staging.arg_names, &p->staged, &p->ellipse_cnt_idx, &p->ellipse_list_idx);
+
+	p->packers = calloc(p->staged.img_arg_cnt, sizeof(PackedReadback));
+	if(!p->packers)
+	{
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "packed readback array"};
+		return;
+	}
+	for(uint16_t i = 0; i < p->staged.img_arg_cnt; ++i)
+	{
+		if(!(p->staged.arg_host_flags[i] & CLBP_AHF_OUTPUT))
+			continue;
+		createPackedReadback(p->context, p->device, cfg->kernel_src_dir, cfg->build_args, &p->staged, i, &p->packers[i], e);
+		if(e->err_code)
+			return;
+	}
+}
+
+void processFrame(Pipeline* p, uint8_t const* frame, clbp_Error* e)
+{
+	writeInputImage(p->queue, &p->staged, 0, frame, e);
+	if(e->err_code)
+		return;
+	scheduleSampledStages(p->context, &p->staging, &p->staged, p->frame_idx, e);
+	if(e->err_code)
+		return;
+	enqueueStagedQ(p->queue, &p->staged, e);
+	if(e->err_code)
+		return;
+	e->err_code = clFinish(p->queue);
+	if(e->err_code)
+	{
+		e->detail = "clFinish";
+		return;
+	}
+	++p->frame_idx;
+}
+
+static void releaseSizeConfig(PipelineSizeConfig* cfg, uint16_t arg_cnt)
+{
+	if(cfg->args)
+	{
+		for(uint32_t i = 0; i < 2u * arg_cnt; ++i)
+		{
+			if(cfg->args[i])
+				clReleaseMemObject(cfg->args[i]);
+		}
+	}
+	free(cfg->sizes);
+	free(cfg->args);
+	*cfg = (PipelineSizeConfig){0};
+}
+
+static char allocSizeConfig(PipelineSizeConfig* cfg, uint16_t arg_cnt, uint16_t stage_cnt)
+{
+	*cfg = (PipelineSizeConfig){0};
+	cfg->sizes = malloc((arg_cnt + stage_cnt) * sizeof(Size3D));
+	cfg->args = calloc(2 * arg_cnt, sizeof(cl_mem));
+	if(cfg->sizes && cfg->args)
+		return 1;
+	free(cfg->sizes);
+	free(cfg->args);
+	*cfg = (PipelineSizeConfig){0};
+	return 0;
+}
+
+// calculates the arg sizes and NDRanges for a new frame size and creates the args that came out different from the current ones,
+// the rest get another reference to the current mem object
+static void buildSizeConfig(Pipeline* p, int width, int height, PipelineSizeConfig* next, clbp_Error* e)
+{
+	uint16_t arg_cnt = p->staged.img_arg_cnt;
+	uint16_t stage_cnt = p->staged.stage_cnt;
+	Size3D* sizes = next->sizes;
+	RangeData* input_calc = &p->staging.arg_size_calcs[0];
+	input_calc->param[0] = width;
+	input_calc->param[1] = height;
+	calcSizeByMode(sizes, p->staging.arg_size_calcs, sizes, arg_cnt, e);
+	if(!e->err_code)
+		calcSizeByMode(sizes, p->staging.range_calcs, sizes + arg_cnt, stage_cnt, e);
+	if(!e->err_code)
+	{	// same arrays as the current config but with the new sizes, so the plan matches what is about to be allocated
+		StagedQ planned = p->staged;
+		planned.img_sizes = sizes;
+		planned.ranges = sizes + arg_cnt;
+		planDeviceMemory(p->device, &p->staging, &planned, e);
+	}
+	// sizes are only recalculated from this on the next resize so it has to describe the active size
+	input_calc->param[0] = p->width;
+	input_calc->param[1] = p->height;
+	if(e->err_code)
+		return;
+
+	next->width = width;
+	next->height = height;
+	for(uint16_t i = 0; i < arg_cnt; ++i)
+	{
+		cl_mem* packed = &next->args[arg_cnt + i];
+		PackedReadback const* pr = &p->packers[i];
+		if(!memcmp(&sizes[i], &p->staged.img_sizes[i], sizeof(Size3D)))
+		{
+			next->args[i] = p->staged.img_args[i];
+			if(next->args[i])
+				clRetainMemObject(next->args[i]);
+			if(pr->packed)
+			{
+				*packed = pr->packed;
+				clRetainMemObject(*packed);
+			}
+			continue;
+		}
+		// left for the next frame that samples it to create at the new size
+		if(p->staged.arg_host_flags[i] & CLBP_AHF_DEFERRED)
+			continue;
+
+		next->args[i] = createArgMem(p->context, &p->staging, i, sizes[i].d, e);
+		if(e->err_code)
+			return;
+		if(!pr->kernel)
+			continue;
+		size_t byte_cnt = sizes[i].d[0] * sizes[i].d[1] * pr->channel_cnt;
+		*packed = clCreateBuffer(p->context, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, byte_cnt, NULL, &e->err_code);
+		if(e->err_code)
+		{
+			e->detail = "clCreateBuffer";
+			return;
+		}
+	}
+}
+
+// moves the staged args and packed readback buffers into out and the ones from in into the staged arrays along with in's sizes,
+// out's sizes have to be saved beforehand since they're overwritten instead of moved
+static void swapSizeConfig(Pipeline* p, PipelineSizeConfig* out, PipelineSizeConfig* in)
+{
+	uint16_t arg_cnt = p->staged.img_arg_cnt;
+	memcpy(p->staged.img_sizes, in->sizes, arg_cnt * sizeof(Size3D));
+	memcpy(p->staged.ranges, in->sizes + arg_cnt, p->staged.stage_cnt * sizeof(Size3D));
+	for(uint16_t i = 0; i < arg_cnt; ++i)
+	{
+		PackedReadback* pr = &p->packers[i];
+		out->args[i] = p->staged.img_args[i];
+		out->args[arg_cnt + i] = pr->packed;
+		p->staged.img_args[i] = in->args[i];
+		pr->packed = in->args[arg_cnt + i];	// both NULL if the arg isn't packed
+		in->args[i] = NULL;
+		in->args[arg_cnt + i] = NULL;
+	}
+}
+
+// sets arg idx and its packed readback again if it's a different mem object than the one old holds for it
+static void bindResizedArg(Pipeline* p, PipelineSizeConfig const* old, uint16_t idx, clbp_Error* e)
+{
+	if(p->staged.img_args[idx] == old->args[idx])
+		return;
+	rebindArg(&p->staging, &p->staged, idx, e);
+	PackedReadback* pr = &p->packers[idx];
+	if(!e->err_code && pr->kernel)
+		setPackedReadbackTarget(&p->staged, idx, pr, pr->packed, e);
+}
+
+void resizePipeline(Pipeline* p, int width, int height, clbp_Error* e)
+{
+	if(width == p->width && height == p->height)
+		return;
+
+	uint16_t arg_cnt = p->staged.img_arg_cnt;
+	uint16_t stage_cnt = p->staged.stage_cnt;
+	// the current size gets moved into the least recently used cache entry, a hit is taken out of the cache before that
+	// so it can't be the one evicted
+	PipelineSizeConfig next = {0};
+	PipelineSizeConfig* evicted = &p->size_cache[0];
+	for(int i = 0; i < PIPELINE_SIZE_CACHE_CNT; ++i)
+	{
+		PipelineSizeConfig* entry = &p->size_cache[i];
+		if(entry->width == width && entry->height == height)
+		{
+			next = *entry;
+			*entry = (PipelineSizeConfig){0};
+			evicted = entry;
+			break;
+		}
+		if(evicted->width && (!entry->width || entry->last_used < evicted->last_used))
+			evicted = entry;
+	}
+
+	PipelineSizeConfig prev;
+	if(!allocSizeConfig(&prev, arg_cnt, stage_cnt))
+	{
+		*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "frame size cache"};
+		if(next.width)
+			*evicted = next;	// put the hit back
+		return;
+	}
+	if(!next.width)
+	{
+		if(!allocSizeConfig(&next, arg_cnt, stage_cnt))
+			*e = (clbp_Error){.err_code = CLBP_OUT_OF_MEMORY, .detail = "frame size cache"};
+		else
+			buildSizeConfig(p, width, height, &next, e);
+		if(e->err_code)
+		{
+			releaseSizeConfig(&next, arg_cnt);
+			releaseSizeConfig(&prev, arg_cnt);
+			return;
+		}
+	}
+
+	// the staged arrays' references move into prev and next's move into the staged arrays, mem objects shared by both
+	// sizes end up with a reference from each, nothing here can fail so it's all undone the same way if rebinding does
+	prev.width = p->width;
+	prev.height = p->height;
+	memcpy(prev.sizes, p->staged.img_sizes, arg_cnt * sizeof(Size3D));
+	memcpy(prev.sizes + arg_cnt, p->staged.ranges, stage_cnt * sizeof(Size3D));
+	swapSizeConfig(p, &prev, &next);
+
+	uint16_t i = 0;
+	for(; i < arg_cnt && !e->err_code; ++i)
+		bindResizedArg(p, &prev, i, e);
+	if(e->err_code)
+	{	// swap everything back and rebind what was already rebound, the previous objects were bound before so that can't fail
+		swapSizeConfig(p, &next, &prev);
+		clbp_Error undo_e = {0};
+		for(uint16_t j = 0; j < i; ++j)
+			bindResizedArg(p, &next, j, &undo_e);
+		releaseSizeConfig(&prev, arg_cnt);
+		// still a complete config for that size so it can be cached if there's room, including putting back a hit
+		if(!evicted->width)
+			*evicted = next;
+		else
+			releaseSizeConfig(&next, arg_cnt);
+		return;
+	}
+	prev.last_used = p->resize_cnt++;
+	p->staging.arg_size_calcs[0].param[0] = width;
+	p->staging.arg_size_calcs[0].param[1] = height;
+	p->width = width;
+	p->height = height;
+
+	releaseSizeConfig(&next, arg_cnt);
+	releaseSizeConfig(evicted, arg_cnt);
+	*evicted = prev;
+}
+
+int getPipelineArgIndex(Pipeline const* p, char const* name)
+{
+	return getStringIndex((char const**)p->staging.arg_names, name);
+}
+
+size_t getPipelineImageByteCnt(Pipeline const* p, uint16_t idx)
+{
+	if(p->packers[idx].kernel)
+		return p->packers[idx].byte_cnt;
+	// readImageAsCharArr() converts in place so it needs room for the unconverted image
+	size_t const* size = p->staged.img_sizes[idx].d;
+	return size[0] * size[1] * size[2] * getPixelSize(p->staging.img_arg_stg[idx].format);
+}
+
+uint8_t readPipelineImage(Pipeline* p, uint16_t idx, uint8_t* out, clbp_Error* e)
+{
+	PackedReadback const* pr = &p->packers[idx];
+	if(pr->kernel)
+	{
+		readPackedImage(p->queue, pr, out, e);
+		return e->err_code ? 0 : pr->channel_cnt;
+	}
+
+	// not a 2D image output so it's converted on the host instead
+	e->err_code = clEnqueueReadImage(p->queue, p->staged.img_args[idx], CL_TRUE, (size_t[3]){0}, p->staged.img_sizes[idx].d, 0, 0, out, 0, NULL, NULL);
+	if(e->err_code)
+	{
+		e->detail = "clEnqueueReadImage";
+		return 0;
+	}
+	return readImageAsCharArr((char*)out, &p->staged, idx);
+}
+
+uint32_t readPipelineEllipses(Pipeline* p, EllipseRecord* out, uint32_t max_cnt, uint32_t* total_cnt, clbp_Error* e)
+{
+	*total_cnt = 0;
+	if(p->ellipse_list_idx < 0)
+		return 0;
+	return readEllipseList(p->queue, &p->staged, p->ellipse_cnt_idx, p->ellipse_list_idx, out, max_cnt, total_cnt, e);
+}
+
+void destroyPipeline(Pipeline* p)
+{
+	for(int i = 0; i < PIPELINE_SIZE_CACHE_CNT; ++i)
+		releaseSizeConfig(&p->size_cache[i], p->staged.img_arg_cnt);
+	if(p->packers)
+	{
+		for(uint16_t i = 0; i < p->staged.img_arg_cnt; ++i)
+			releasePackedReadback(&p->packers[i]);
+		free(p->packers);
+	}
+	if(p->is_staged)
+		freeStagedQArrays(&p->staged);
+	if(p->staging.kern_stg)
+		freeQStagingArrays(&p->staging);
+	if(p->manifest)
+		toml_free(p->manifest);
+	if(p->program)
+		clReleaseProgram(p->program);
+	if(p->queue)
+		clReleaseCommandQueue(p->queue);
+	if(p->context)
+		clReleaseContext(p->context);
+	*p = (Pipeline){.ellipse_cnt_idx = -1, .ellipse_list_idx = -1};
+}
@@ -8,6 +8,7 @@ char const* modeNames[] = {
 	"CLBP_RM_ROW",
 	"CLBP_RM_COLUMN",
 	"DIAGONAL",
+	"DIVIDE_CEIL",
 	//
 	NULL
 };
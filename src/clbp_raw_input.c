@@ -0,0 +1,292 @@
+#include "clbp_raw_input.h"
+#include "cl_boilerplate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static char const* getExtension(char const* fname)
+{
+	char const* dot = strrchr(fname, '.');
+	return dot ? dot + 1 : "";
+}
+
+char isRawFrameFile(char const* fname)
+{
+	char const* ext = getExtension(fname);
+	return !strcmp(ext, "y4m") || !strcmp(ext, "pgm") || !strcmp(ext, "y8");
+}
+
+static char mapFile(RawFrameFile* raw, char const* fname)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return 0;
+	raw->file_handle = file;
+
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(file, &size) || !size.QuadPart)
+		return 0;
+	raw->map_len = size.QuadPart;
+
+	raw->mapping_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!raw->mapping_handle)
+		return 0;
+	raw->map = MapViewOfFile(raw->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	return raw->map != NULL;
+#else
+	int fd = open(fname, O_RDONLY);
+	if(fd < 0)
+		return 0;
+
+	struct stat info;
+	if(fstat(fd, &info) || !info.st_size)
+	{
+		close(fd);
+		return 0;
+	}
+	raw->map_len = info.st_size;
+
+	void* map = mmap(NULL, raw->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);	// the mapping keeps its own reference to the file
+	if(map == MAP_FAILED)
+		return 0;
+	raw->map = map;
+#ifdef MADV_SEQUENTIAL
+	// frames are consumed front to back, lets the kernel read ahead aggressively
+	madvise(map, raw->map_len, MADV_SEQUENTIAL);
+#endif
+	return 1;
+#endif
+}
+
+static char addFrameOffset(RawFrameFile* raw, uint32_t* cap, size_t offset)
+{
+	if(raw->frame_cnt == *cap)
+	{
+		uint32_t new_cap = *cap ? *cap * 2 : 64;
+		size_t* new_offsets = realloc(raw->frame_offsets, new_cap * sizeof(size_t));
+		if(!new_offsets)
+			return 0;
+		raw->frame_offsets = new_offsets;
+		*cap = new_cap;
+	}
+	raw->frame_offsets[raw->frame_cnt++] = offset;
+	return 1;
+}
+
+// reads a whitespace separated non-negative decimal, skipping PGM style # comments, returns -1 on failure
+static int readHeaderInt(uint8_t const* data, size_t len, size_t* pos)
+{
+	while(*pos < len && (isspace(data[*pos]) || data[*pos] == '#'))
+	{
+		if(data[*pos] == '#')
+			while(*pos < len && data[*pos] != '\n')
+				++*pos;
+		else
+			++*pos;
+	}
+
+	int val = -1;
+	while(*pos < len && isdigit(data[*pos]) && val < 1 << 20)
+		val = (val < 0 ? 0 : val * 10) + (data[(*pos)++] - '0');
+	return val;
+}
+
+// every image must be 8-bit binary and match the size of the first one
+static cl_int indexPgmFrames(RawFrameFile* raw, uint32_t* cap)
+{
+	size_t pos = 0;
+	uint8_t const* data = raw->map;
+	while(pos < raw->map_len)
+	{
+		// tolerate trailing whitespace after the last image
+		while(pos < raw->map_len && isspace(data[pos]))
+			++pos;
+		if(pos == raw->map_len)
+			break;
+
+		if(raw->map_len - pos < 2 || data[pos] != 'P' || data[pos+1] != '5')
+			return CLBP_INVALID_FRAME_FILE;
+		pos += 2;
+		int width = readHeaderInt(data, raw->map_len, &pos);
+		int height = readHeaderInt(data, raw->map_len, &pos);
+		int max_val = readHeaderInt(data, raw->map_len, &pos);
+		// exactly 1 whitespace character separates the header from the pixel data
+		if(width <= 0 || height <= 0 || max_val <= 0 || max_val > 255 || pos >= raw->map_len || !isspace(data[pos]))
+			return CLBP_INVALID_FRAME_FILE;
+		++pos;
+
+		if(!raw->frame_cnt)
+		{
+			raw->width = width;
+			raw->height = height;
+		}
+		else if(width != raw->width || height != raw->height)
+			return CLBP_INVALID_FRAME_SIZE;
+
+		size_t frame_len = (size_t)width * height;
+		if(raw->map_len - pos < frame_len)	// truncated last image
+			break;
+		if(!addFrameOffset(raw, cap, pos))
+			return CLBP_OUT_OF_MEMORY;
+		pos += frame_len;
+	}
+	return raw->frame_cnt ? CLBP_OK : CLBP_INVALID_FRAME_FILE;
+}
+
+// returns the number of bytes of chroma (and alpha) that follow the luma plane of each frame, or -1 if unsupported
+static long long getY4mExtraPlaneLen(char const* tag, size_t tag_len, int w, int h)
+{
+	long long half_w = (w + 1) / 2;
+	// anything with a bit depth suffix, ie. 420p10 or mono16, isn't 8-bit
+	if(tag_len >= 4 && !strncmp(tag, "mono", 4))
+		return tag_len == 4 ? 0 : -1;
+	if(tag_len > 4 && tag[3] == 'p' && isdigit(tag[4]))
+		return -1;
+	if(tag_len >= 8 && !strncmp(tag, "444alpha", 8))
+		return 3LL * w * h;
+	if(tag_len < 3)
+		return -1;
+	if(!strncmp(tag, "420", 3))
+		return 2 * half_w * ((h + 1) / 2);
+	if(!strncmp(tag, "422", 3))
+		return 2 * half_w * h;
+	if(!strncmp(tag, "444", 3))
+		return 2LL * w * h;
+	if(!strncmp(tag, "411", 3))
+		return 2LL * ((w + 3) / 4) * h;
+	return -1;
+}
+
+static cl_int indexY4mFrames(RawFrameFile* raw, uint32_t* cap)
+{
+	uint8_t const* data = raw->map;
+	uint8_t const* header_end = memchr(data, '\n', raw->map_len);
+	if(raw->map_len < 10 || memcmp(data, "YUV4MPEG2 ", 10) || !header_end)
+		return CLBP_INVALID_FRAME_FILE;
+
+	char const* chroma = "420jpeg";	// default when no C tag is present
+	size_t chroma_len = 7;
+	for(char const* tag = (char const*)data + 10; tag < (char const*)header_end; ++tag)
+	{
+		if(tag[-1] != ' ')
+			continue;
+		size_t tag_len = strcspn(tag, " \n");
+		switch(*tag)
+		{
+		case 'W':
+			raw->width = atoi(tag + 1);
+			break;
+		case 'H':
+			raw->height = atoi(tag + 1);
+			break;
+		case 'C':
+			chroma = tag + 1;
+			chroma_len = tag_len - 1;
+			break;
+		}
+	}
+
+	long long extra_len = getY4mExtraPlaneLen(chroma, chroma_len, raw->width, raw->height);
+	if(raw->width <= 0 || raw->height <= 0 || extra_len < 0)
+		return CLBP_INVALID_FRAME_FILE;
+
+	size_t luma_len = (size_t)raw->width * raw->height;
+	size_t pos = header_end - data + 1;
+	while(raw->map_len - pos >= 5 && !memcmp(data + pos, "FRAME", 5))
+	{
+		// frame headers can carry parameters, skip to the end of the line
+		uint8_t const* frame_header_end = memchr(data + pos, '\n', raw->map_len - pos);
+		if(!frame_header_end)
+			break;
+		pos = frame_header_end - data + 1;
+		if(raw->map_len - pos < luma_len + extra_len)	// truncated last frame
+			break;
+		if(!addFrameOffset(raw, cap, pos))
+			return CLBP_OUT_OF_MEMORY;
+		pos += luma_len + extra_len;
+	}
+	return raw->frame_cnt ? CLBP_OK : CLBP_INVALID_FRAME_FILE;
+}
+
+static cl_int indexY8Frames(RawFrameFile* raw, uint32_t* cap, int width, int height)
+{
+	if(width <= 0 || height <= 0)
+		return CLBP_INVALID_FRAME_FILE;
+	raw->width = width;
+	raw->height = height;
+
+	size_t frame_len = (size_t)width * height;
+	for(size_t pos = 0; raw->map_len - pos >= frame_len; pos += frame_len)
+	{
+		if(!addFrameOffset(raw, cap, pos))
+			return CLBP_OUT_OF_MEMORY;
+	}
+	return raw->frame_cnt ? CLBP_OK : CLBP_INVALID_FRAME_FILE;
+}
+
+void openRawFrameFile(RawFrameFile* raw, char const* fname, int width, int height, clbp_Error* e)
+{
+	*raw = (RawFrameFile){0};
+	if(!mapFile(raw, fname))
+	{
+		closeRawFrameFile(raw);
+		*e = (clbp_Error){.err_code = CLBP_FILE_NOT_FOUND, .detail = (char*)fname};
+		return;
+	}
+
+	uint32_t cap = 0;
+	char const* ext = getExtension(fname);
+	if(!strcmp(ext, "y4m"))
+	{
+		raw->format = CLBP_RAW_Y4M;
+		e->err_code = indexY4mFrames(raw, &cap);
+	}
+	else if(!strcmp(ext, "pgm"))
+	{
+		raw->format = CLBP_RAW_PGM;
+		e->err_code = indexPgmFrames(raw, &cap);
+	}
+	else
+	{
+		raw->format = CLBP_RAW_Y8;
+		e->err_code = indexY8Frames(raw, &cap, width, height);
+	}
+
+	if(e->err_code)
+	{
+		e->detail = e->err_code == CLBP_OUT_OF_MEMORY ? "raw frame offsets" : (char*)fname;
+		closeRawFrameFile(raw);
+		return;
+	}
+
+	printf("mapped %s, %u %i*%i frame(s).\n", fname, raw->frame_cnt, raw->width, raw->height);
+}
+
+void closeRawFrameFile(RawFrameFile* raw)
+{
+#ifdef _WIN32
+	if(raw->map)
+		UnmapViewOfFile(raw->map);
+	if(raw->mapping_handle)
+		CloseHandle(raw->mapping_handle);
+	if(raw->file_handle && raw->file_handle != INVALID_HANDLE_VALUE)
+		CloseHandle(raw->file_handle);
+#else
+	if(raw->map)
+		munmap((void*)raw->map, raw->map_len);
+#endif
+	free(raw->frame_offsets);
+	*raw = (RawFrameFile){0};
+}
@@ -214,6 +214,11 @@ void calcSizeByMode(Size3D const* ref_arr, RangeData const* range_arr, Size3D* d
 			out[1] = in[1] / param[1];
 			out[2] = in[2] / param[2];
 			break;
+		case CLBP_RM_DIVIDE_CEIL:
+			out[0] = (in[0] + param[0] - 1) / param[0];
+			out[1] = (in[1] + param[1] - 1) / param[1];
+			out[2] = (in[2] + param[2] - 1) / param[2];
+			break;
 		case CLBP_RM_MULTIPLY:
 			out[0] = in[0] * param[0];
 			out[1] = in[1] * param[1];
@@ -0,0 +1,832 @@
+#include "cpu_pipeline.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// flag and index layout of the continuation data, same as link_macros.cl
+#define HAS_R_CONT		(1 << 3)
+#define HAS_L_CONT		(1 << 4)
+#define HAS_BOTH_CONT	(HAS_L_CONT | HAS_R_CONT)
+#define R_CONT_IDX_MASK	(HAS_R_CONT - 1)
+#define END_ADJ_SHIFT	6
+#define IS_END_ADJ		(1 << END_ADJ_SHIFT)
+#define IS_START		(1 << 7)
+#define L_CONT_IDX_SHIFT	5
+
+#define SCHARR_THRESH	9
+
+char const* cpuStageNames[CPU_STAGE_CNT] = {
+	"scharr3_char",
+	"non_max_sup",
+	"link_edge_pixels",
+	"find_segment_starts",
+	"serial_reduce",
+	"line_segments",
+	"arc_builder",
+};
+
+// clockwise neighbor offsets, same ordering as offsets_LUT.cl
+static const int8_t offsets[8][2] = {{1,0},{1,1},{0,1},{-1,1},{-1,0},{-1,-1},{0,-1},{1,-1}};
+
+typedef struct {
+	CpuPipeline* cpu;
+	uint8_t const* input;
+	uint16_t* band_starts;	// per row start counts used to parallelize serial_reduce
+} CpuRun;
+
+static inline char isInBounds(CpuPipeline const* cpu, int x, int y)
+{
+	return x >= 0 && y >= 0 && x < cpu->width && y < cpu->height;
+}
+
+// equivalent of reading with the "clamped" sampler, out of bounds reads return the border color (0)
+static inline int8_t readGradAng(CpuPipeline const* cpu, int x, int y)
+{
+	return isInBounds(cpu, x, y) ? cpu->grad_ang[x + y * cpu->width] : 0;
+}
+
+static inline uint8_t readCont(CpuPipeline const* cpu, uint8_t const* cont, int x, int y)
+{
+	return isInBounds(cpu, x, y) ? cont[x + y * cpu->width] : 0;
+}
+
+static double msSince(struct timespec const* start)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+//---------------------------------------------------------------------------------------
+// scharr3_char
+
+// shared tail of the gradient calculation, only pixels that meet the threshold need the angle
+static inline void writeGrad(uint8_t* out, float grad_x, float grad_y, int32_t mag)
+{
+	if(mag <= 0)
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+	out[0] = (int8_t)(int)floor(atan2((double)grad_y, (double)grad_x) / M_PI * 128);
+	out[1] = mag > 255 ? 255 : mag;
+}
+
+// clamp to edge reads, only used around the border
+static void scharrPixel(CpuRun const* run, int x, int y)
+{
+	CpuPipeline const* cpu = run->cpu;
+	int w = cpu->width;
+	int xm = x > 0 ? x - 1 : 0, xp = x < w - 1 ? x + 1 : x;
+	int ym = y > 0 ? y - 1 : 0, yp = y < cpu->height - 1 ? y + 1 : y;
+	uint8_t const* in = run->input;
+	const float scale = 1.0f / 255;
+
+	float diag = (in[xp + yp*w] - in[xm + ym*w]) * scale;
+	float grad_x = (in[xp + y*w] - in[xm + y*w]) * scale;
+	float grad_y = (in[x + yp*w] - in[x + ym*w]) * scale;
+	grad_x = grad_x * 3.44680851f + diag;
+	grad_y = grad_y * 3.44680851f + diag;
+	diag = (in[xp + ym*w] - in[xm + yp*w]) * scale;
+	grad_x += diag;
+	grad_y -= diag;
+
+	writeGrad(&cpu->grad[(x + y*w) * 2], grad_x, grad_y, lrintf(sqrtf(grad_x*grad_x + grad_y*grad_y) * 38 - SCHARR_THRESH));
+}
+
+#ifdef __SSE2__
+// 4 consecutive pixels widened to floats, the pointer has no alignment and isn't an int32_t so it's copied out instead of cast
+static inline __m128 load4Pixels(uint8_t const* p)
+{
+	int32_t packed;
+	memcpy(&packed, p, sizeof(packed));
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero));
+}
+#endif
+
+static void scharrBand(void* ctx, int y_start, int y_end)
+{
+	CpuRun const* run = ctx;
+	int w = run->cpu->width, h = run->cpu->height;
+
+	for(int y = y_start; y < y_end; ++y)
+	{
+		if(y == 0 || y == h - 1 || w < 3)
+		{
+			for(int x = 0; x < w; ++x)
+				scharrPixel(run, x, y);
+			continue;
+		}
+
+		scharrPixel(run, 0, y);
+		int x = 1;
+		uint8_t const* up = run->input + (y - 1) * w;
+		uint8_t const* mid = run->input + y * w;
+		uint8_t const* down = run->input + (y + 1) * w;
+		uint8_t* out = run->cpu->grad + y * w * 2;
+#ifdef __SSE2__
+		// 4 pixels per iteration, magnitude is vectorized and the angle is only computed for the few that pass the threshold
+		const __m128 scale = _mm_set1_ps(1.0f / 255);
+		const __m128 weight = _mm_set1_ps(3.44680851f);
+		const __m128 mag_scale = _mm_set1_ps(38);
+		const __m128 thresh = _mm_set1_ps(SCHARR_THRESH);
+		const __m128i zero = _mm_setzero_si128();
+		for(; x + 4 < w; x += 4)
+		{
+#define LOAD4(row, offset)	load4Pixels((row) + x + (offset))
+			__m128 diag = _mm_mul_ps(_mm_sub_ps(LOAD4(down, 1), LOAD4(up, -1)), scale);
+			__m128 grad_x = _mm_mul_ps(_mm_sub_ps(LOAD4(mid, 1), LOAD4(mid, -1)), scale);
+			__m128 grad_y = _mm_mul_ps(_mm_sub_ps(LOAD4(down, 0), LOAD4(up, 0)), scale);
+			grad_x = _mm_add_ps(_mm_mul_ps(grad_x, weight), diag);
+			grad_y = _mm_add_ps(_mm_mul_ps(grad_y, weight), diag);
+			diag = _mm_mul_ps(_mm_sub_ps(LOAD4(up, 1), LOAD4(down, -1)), scale);
+#undef LOAD4
+			grad_x = _mm_add_ps(grad_x, diag);
+			grad_y = _mm_sub_ps(grad_y, diag);
+
+			__m128 mag = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(grad_x, grad_x), _mm_mul_ps(grad_y, grad_y)));
+			mag = _mm_sub_ps(_mm_mul_ps(mag, mag_scale), thresh);
+			// round to nearest even like convert_uchar_sat_rte, saturation happens in writeGrad()
+			__m128i mag_i = _mm_cvtps_epi32(mag);
+			if(!_mm_movemask_epi8(_mm_cmpgt_epi32(mag_i, zero)))
+			{	// most common case, nothing met the threshold
+				memset(out + x * 2, 0, 8);
+				continue;
+			}
+
+			float gx[4], gy[4];
+			int32_t m[4];
+			_mm_storeu_ps(gx, grad_x);
+			_mm_storeu_ps(gy, grad_y);
+			_mm_storeu_si128((__m128i*)m, mag_i);
+			for(int i = 0; i < 4; ++i)
+				writeGrad(out + (x + i) * 2, gx[i], gy[i], m[i]);
+		}
+#endif//__SSE2__
+		for(; x < w - 1; ++x)
+			scharrPixel(run, x, y);
+		scharrPixel(run, w - 1, y);
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// non_max_sup
+
+static void nonMaxSupBand(void* ctx, int y_start, int y_end)
+{
+	CpuPipeline* cpu = ((CpuRun const*)ctx)->cpu;
+	int w = cpu->width;
+
+	for(int y = y_start; y < y_end; ++y)
+	{
+		for(int x = 0; x < w; ++x)
+		{
+			uint8_t const* grad = &cpu->grad[(x + y*w) * 2];
+			int8_t* out = &cpu->grad_ang[x + y*w];
+			*out = 0;
+			if(!grad[1])
+				continue;
+
+			uint8_t dir_idx = ((grad[0] + 16) >> 5) & 3;
+			int dx = offsets[dir_idx][0], dy = offsets[dir_idx][1];
+			// magnitudes along and against the gradient direction, out of bounds reads as 0
+			uint8_t mag_a = isInBounds(cpu, x + dx, y + dy) ? cpu->grad[(x + dx + (y + dy)*w) * 2 + 1] : 0;
+			uint8_t mag_b = isInBounds(cpu, x - dx, y - dy) ? cpu->grad[(x - dx + (y - dy)*w) * 2 + 1] : 0;
+
+			if(mag_a > grad[1] || mag_b > grad[1])
+				continue;
+			if((mag_a == grad[1] || mag_b == grad[1]) && ((x ^ y) & 1))
+				continue;
+
+			*out = (int8_t)grad[0] | 1;
+		}
+	}
+}
+
+//---------------------------------------------------------------------------------------
+// link_edge_pixels
+
+// returns the indices of the minimum and 2nd minimum of comp
+static void selectMin2(uint8_t const comp[8], uint8_t index[2])
+{
+	index[0] = 0;
+	index[1] = 1;
+	uint8_t min_pos = comp[0] > comp[1];
+	for(uint8_t i = 2; i < 8; ++i)
+	{
+		if(comp[i] < comp[index[!min_pos]])
+		{
+			index[!min_pos] = i;
+			if(comp[i] <= comp[index[min_pos]])
+				min_pos = !min_pos;
+		}
+	}
+}
+
+static inline int lowestBit(uint8_t bits)
+{	return __builtin_ctz(bits);	}
+
+static inline int highestBit(uint8_t bits)
+{	return 31 - __builtin_clz(bits);	}
+
+// the kernel works on all 8 neighbors at once packed into a long, here each byte lane is a bit of an 8-bit mask instead
+static uint8_t linkPixel(CpuPipeline const* cpu, int x, int y)
+{
+	int8_t grad_ang = cpu->grad_ang[x + y * cpu->width];
+	if(!grad_ang)
+		return 0;
+
+	int8_t neighbors[8];
+	uint8_t diff[8], small_mask = 0, any_neighbor = 0;
+	for(int i = 0; i < 8; ++i)
+	{
+		neighbors[i] = readGradAng(cpu, x + offsets[i][0], y + offsets[i][1]);
+		any_neighbor |= neighbors[i];
+		// unoccupied slots are set to the max difference so they never get selected
+		int d = (int8_t)(neighbors[i] - grad_ang);
+		diff[i] = (neighbors[i] & 1) ? (d < 0 ? -d : d) : 255;
+		small_mask |= (diff[i] < 64) << i;
+	}
+
+	// orphan pixels and pixels exclusively surrounded by pixels with high angular differences relative to them are rejected
+	if(!any_neighbor || !small_mask)
+		return 0;
+
+	uint8_t index[2];
+	uint8_t adj_small_mask;
+	int adj_small_pcnt;
+	switch(__builtin_popcount(small_mask))
+	{
+	case 1:		// only 1 continuation
+		index[0] = lowestBit(small_mask);
+		return (grad_ang - (index[0] << 5) < 0) ? index[0] | HAS_R_CONT : (index[0] << L_CONT_IDX_SHIFT) | HAS_L_CONT;
+	default:	// more than 2 continuations...
+		adj_small_mask = 0x55 & small_mask;
+		// priority for continuations is given to face adjacent pixels
+		adj_small_pcnt = __builtin_popcount(adj_small_mask);
+		if(adj_small_pcnt == 1)	// but only 1 face adjacent
+		{
+			uint8_t adj_idx = lowestBit(adj_small_mask);
+			// select the 2 corners not adjacent to the face adjacent one
+			index[0] = (3 + adj_idx) & 7;
+			index[1] = (5 + adj_idx) & 7;
+			// replace whichever has a larger difference with the face adjacent one
+			index[index[1] > index[0]] = adj_idx;
+			break;
+		}
+		else	// either 2+ face adjacent or 3+ corner adjacent
+		{
+			if(adj_small_pcnt >= 2)	// 2+ face adjacent
+				small_mask = adj_small_mask;
+			if(adj_small_pcnt != 2)
+			{
+				for(int i = 0; i < 8; ++i)
+					if(!(small_mask & (1 << i)))
+						diff[i] = 255;
+				selectMin2(diff, index);
+			}
+		}
+		//NOTE: falls through and overwrites the selected minimums the same way link_edge_pixels.cl does
+	case 2:		// only 2 continuations
+		index[0] = lowestBit(small_mask);
+		index[1] = highestBit(small_mask);
+	}
+	int8_t ref_ang = (index[0] + index[1] - 4) << 4;
+	uint8_t order = (index[0] > index[1]) ^ ((int8_t)(grad_ang - ref_ang) < 0);
+	return HAS_BOTH_CONT | index[!order] | (index[order] << L_CONT_IDX_SHIFT);
+}
+
+static void linkBand(void* ctx, int y_start, int y_end)
+{
+	CpuPipeline* cpu = ((CpuRun const*)ctx)->cpu;
+	for(int y = y_start; y < y_end; ++y)
+		for(int x = 0; x < cpu->width; ++x)
+			cpu->cont[x + y * cpu->width] = linkPixel(cpu, x, y);
+}
+
+//---------------------------------------------------------------------------------------
+// find_segment_starts
+
+static uint8_t findStartPixel(CpuPipeline const* cpu, int x, int y)
+{
+	uint8_t cont_data = cpu->cont[x + y * cpu->width];
+	uint8_t adjacent_data, adjacent_idx;
+	int adj_x, adj_y;
+	uint8_t is_end_adjacent = 0;
+
+	// y-junction prevention, stops multiple edges that would join to process a shared region
+	if(cont_data & HAS_R_CONT)
+	{
+		adjacent_idx = cont_data & R_CONT_IDX_MASK;
+		adjacent_data = readCont(cpu, cpu->cont, x + offsets[adjacent_idx][0], y + offsets[adjacent_idx][1]);
+		is_end_adjacent = (adjacent_data & HAS_BOTH_CONT) != HAS_BOTH_CONT || (((adjacent_data >> L_CONT_IDX_SHIFT) ^ adjacent_idx) != 4);
+	}
+
+	switch(cont_data & HAS_BOTH_CONT)
+	{
+	default:	// not an edge or a standard right end
+		return 0;
+	case HAS_BOTH_CONT:
+		adjacent_idx = cont_data >> L_CONT_IDX_SHIFT;
+		cont_data &= 0x1F;
+		adj_x = x + offsets[adjacent_idx][0];
+		adj_y = y + offsets[adjacent_idx][1];
+		adjacent_data = readCont(cpu, cpu->cont, adj_x, adj_y) & 0xF;
+		// mutual left link, only a start if it qualifies as a loop breaking start
+		if((adjacent_data ^ adjacent_idx) == 0xC)
+		{
+			if(cpu->grad_ang[x + y * cpu->width] < 0)
+				break;
+			if(readGradAng(cpu, adj_x, adj_y) > 0)
+				break;
+		}
+		// fall-through to add start flag
+	case HAS_R_CONT:
+		if(is_end_adjacent)
+			break;
+		cont_data |= IS_START;
+	}
+
+	return cont_data | (is_end_adjacent << END_ADJ_SHIFT);
+}
+
+static void findStartsBand(void* ctx, int y_start, int y_end)
+{
+	CpuPipeline* cpu = ((CpuRun const*)ctx)->cpu;
+	for(int y = y_start; y < y_end; ++y)
+		for(int x = 0; x < cpu->width; ++x)
+			cpu->starts_cont[x + y * cpu->width] = findStartPixel(cpu, x, y);
+}
+
+//---------------------------------------------------------------------------------------
+// serial_reduce, done as a per row count, a scan and then a per row write so it can be split up,
+// order and truncation at CPU_MAX_STARTS are the same as the serial kernel
+
+static inline char isStart(uint8_t cont_data)
+{	return (cont_data & 0xE8) == 0x88;	}
+
+static void countStartsBand(void* ctx, int y_start, int y_end)
+{
+	CpuRun const* run = ctx;
+	CpuPipeline const* cpu = run->cpu;
+	for(int y = y_start; y < y_end; ++y)
+	{
+		uint16_t cnt = 0;
+		for(int x = 0; x < cpu->width; ++x)
+			cnt += isStart(cpu->starts_cont[x + y * cpu->width]);
+		run->band_starts[y] = cnt;
+	}
+}
+
+static void writeStartsBand(void* ctx, int y_start, int y_end)
+{
+	CpuRun const* run = ctx;
+	CpuPipeline* cpu = run->cpu;
+	for(int y = y_start; y < y_end; ++y)
+	{
+		uint32_t index = run->band_starts[y];	// exclusive scan of the counts
+		for(int x = 0; x < cpu->width && index < CPU_MAX_STARTS; ++x)
+		{
+			if(isStart(cpu->starts_cont[x + y * cpu->width]))
+			{
+				cpu->start_coords[index * 2] = x;
+				cpu->start_coords[index * 2 + 1] = y;
+				++index;
+			}
+		}
+	}
+}
+
+static void serialReduce(CpuRun* run, ThreadPool* pool)
+{
+	CpuPipeline* cpu = run->cpu;
+	runBands(pool, cpu->height, countStartsBand, run);
+
+	uint32_t total = 0;
+	for(int y = 0; y < cpu->height; ++y)
+	{
+		uint16_t cnt = run->band_starts[y];
+		run->band_starts[y] = total < CPU_MAX_STARTS ? total : CPU_MAX_STARTS;
+		total += cnt;
+	}
+	cpu->start_cnt = total < CPU_MAX_STARTS ? total : CPU_MAX_STARTS;
+
+	runBands(pool, cpu->height, writeStartsBand, run);
+}
+
+//---------------------------------------------------------------------------------------
+// line_segments, chains are independent so bands are ranges of start indices instead of rows
+
+// unlike the kernel, out of bounds reads act as a start so a corrupt chain can't walk off the image forever
+static inline uint8_t readContInfo(CpuPipeline const* cpu, int x, int y)
+{
+	return isInBounds(cpu, x, y) ? cpu->starts_cont[x + y * cpu->width] : IS_START;
+}
+
+static void traceChain(CpuPipeline* cpu, uint16_t index)
+{
+	int x = cpu->start_coords[index * 2], y = cpu->start_coords[index * 2 + 1];
+	if(!x && !y)	// same (0,0) sentinel as the kernel
+		return;
+
+	uint8_t cont_data, cont_idx, to_end = 0;
+	cont_data = readContInfo(cpu, x, y);
+	cont_idx = cont_data & R_CONT_IDX_MASK;
+
+	uint8_t path_hist[32];
+	// char2 in the kernel, kept as 8-bit so wrap around matches
+	int8_t mid_x, mid_y, end_x = 0, end_y = 0;
+	int base_x = x, base_y = y;
+	uint16_t seg_count = 0;
+	x += offsets[cont_idx][0];
+	y += offsets[cont_idx][1];
+
+	do
+	{
+		base_x += end_x;
+		base_y += end_y;
+		mid_x = end_x = offsets[cont_idx][0];
+		mid_y = end_y = offsets[cont_idx][1];
+		path_hist[0] = cont_idx;
+		++seg_count;
+		for(int len = 1; ; ++len)
+		{
+			cont_data = readContInfo(cpu, x, y);
+
+			cont_idx = cont_data & R_CONT_IDX_MASK;
+			end_x += offsets[cont_idx][0];
+			end_y += offsets[cont_idx][1];
+
+			to_end |= cont_data & IS_START;
+			if(to_end)
+				break;
+			to_end = cont_data & IS_END_ADJ;
+
+			x += offsets[cont_idx][0];
+			y += offsets[cont_idx][1];
+			mid_x += offsets[path_hist[(len >> 1) & 0x1F]][0];
+			mid_y += offsets[path_hist[(len >> 1) & 0x1F]][1];
+			int8_t dev_x = end_x - mid_x, dev_y = end_y - mid_y;
+			if((uint8_t)((int8_t)(dev_x * dev_x) + (int8_t)(dev_y * dev_y)) > 4 || len >= 127)
+				break;
+
+			if(len < 64)
+				path_hist[len & 0x1F] = cont_idx;
+		}
+		end_x -= offsets[cont_idx][0];
+		end_y -= offsets[cont_idx][1];
+		int8_t* line_data = &cpu->line_data[(base_x + base_y * cpu->width) * 2];
+		line_data[0] = end_x;
+		line_data[1] = end_y;
+	} while(!to_end);
+
+	cpu->line_cnts[index] = seg_count;
+}
+
+static void lineSegmentsBand(void* ctx, int start, int end)
+{
+	CpuPipeline* cpu = ((CpuRun const*)ctx)->cpu;
+	for(int i = start; i < end; ++i)
+		traceChain(cpu, i);
+}
+
+//---------------------------------------------------------------------------------------
+// arc_builder, port of arc_fit.cl
+
+static const uint8_t order[8] = {0,1,2,3,0,2,1,3};
+
+// the device's 32-bit int multiply wraps on overflow
+static inline float mulWrap(int32_t a, int32_t b)
+{	return (float)(int32_t)((uint32_t)a * (uint32_t)b);	}
+
+static inline int cross2(int const a[2], int const b[2])
+{	return a[0] * b[1] - a[1] * b[0];	}
+
+// returns 0 if the conic through the 5 points would not be an ellipse
+static char ellipseFromHist(int const diffs[4][2], int const cross_prods[4], float foci[4])
+{
+	float ca[2], ed[2], rs[2], temp_f2[2];
+	float b, temp_f, inv_2t, ac_diff;
+
+	float u =  mulWrap(cross_prods[1], cross_prods[3]) / 137438953472.0f;
+	float v = -mulWrap(cross_prods[0], cross_prods[2]) / 137438953472.0f;
+
+	for(int i = 0; i < 2; ++i)
+		ca[i] = u * (float)(diffs[0][i] * diffs[2][i]) + v * (float)(diffs[1][i] * diffs[3][i]);
+	b  = u * (float)(diffs[0][0] * diffs[2][1] + diffs[0][1] * diffs[2][0]);
+	b += v * (float)(diffs[1][0] * diffs[3][1] + diffs[1][1] * diffs[3][0]);
+
+	inv_2t = (4 * ca[0] * ca[1] - b * b);
+	if(inv_2t <= 0)
+		return 0;
+
+	b = -b;
+	inv_2t = 1 / inv_2t;
+
+	for(int i = 0; i < 2; ++i)
+		ed[i] = u * (cross_prods[0] * (float)diffs[2][i] + cross_prods[2] * (float)diffs[0][i])
+			+ v * (cross_prods[1] * (float)diffs[3][i] + cross_prods[3] * (float)diffs[1][i]);
+	ed[0] = -ed[0];
+
+	rs[0] = b * ed[0];
+	rs[1] = b * ed[1];
+	temp_f = rs[0] * ed[1];
+	temp_f2[0] = ca[0] * ed[1];
+	temp_f2[1] = ca[1] * ed[0];
+	rs[0] -= 2 * temp_f2[0];
+	rs[1] -= 2 * temp_f2[1];
+	ac_diff = ca[1] - ca[0];
+
+	temp_f = 2 * (temp_f - (temp_f2[0] * ed[1] + temp_f2[1] * ed[0]));
+	float hyp = hypotf(ac_diff, b);
+	temp_f2[0] = sqrtf(temp_f * (hyp + ac_diff));
+	temp_f2[1] = sqrtf(temp_f * (hyp - ac_diff));
+
+	if(b < 0)
+		temp_f2[1] *= -1;
+
+	foci[0] = (rs[0] - temp_f2[0]) * inv_2t;
+	foci[1] = (rs[1] - temp_f2[1]) * inv_2t;
+	foci[2] = (rs[0] + temp_f2[0]) * inv_2t;
+	foci[3] = (rs[1] + temp_f2[1]) * inv_2t;
+
+	return isfinite(foci[0]);
+}
+
+static inline float getEllipseDist(float const foci[4])
+{
+	return hypotf(foci[0], foci[1]) + hypotf(foci[2], foci[3]);
+}
+
+static inline char isNearEllipseEdge(float const foci[4], float dist, float px, float py)
+{
+	return fabsf(dist - (hypotf(px - foci[0], py - foci[1]) + hypotf(px - foci[2], py - foci[3]))) < 2;
+}
+
+typedef struct {
+	int base[2];
+	int total_offset[2];
+	int curr_seg[2];
+	int prev_seg[2];
+	int points[4][2];
+	int diffs[4][2];
+	int cross_prods[4];
+	float foci[4];
+	float edge_dist;
+	uint16_t seg_cnt;
+	char reset;
+	int8_t dir_trend;
+	uint8_t kick;
+} ArcState;
+
+static void arcWrite(CpuPipeline* cpu, ArcState const* s)
+{
+	int i = s->base[0] + s->base[1] * cpu->width;
+	cpu->seg_in_arc[i] = s->seg_cnt;
+	if(s->seg_cnt >= 4)
+	{
+		for(int j = 0; j < 4; ++j)
+			cpu->ellipse_foci[i * 4 + j] = s->foci[j] + s->base[j & 1];
+	}
+}
+
+// returns the pixel index the next segment of the chain starts at
+static int arcAdvance(CpuPipeline* cpu, ArcState* s)
+{
+	switch(s->reset)
+	{
+	case 1:	// logical reset, last read segment can't be part of the same elliptical arc
+		arcWrite(cpu, s);
+		s->reset = 0;
+		s->base[0] += s->total_offset[0];
+		s->base[1] += s->total_offset[1];
+		s->total_offset[0] = s->total_offset[1] = 0;
+		s->seg_cnt = 1;
+		s->dir_trend = 0;
+		break;
+	case 2:	// first solve reset, kick first segment and copy things down 1 slot to try again
+		s->reset = 0;
+		cpu->seg_in_arc[s->base[0] + s->base[1] * cpu->width] = 1;
+		int first_point[2] = {s->points[0][0], s->points[0][1]};
+		for(int i = 0; i < 2; ++i)
+		{
+			s->base[i] += first_point[i];
+			s->total_offset[i] -= first_point[i];
+			s->points[0][i] = s->points[1][i] - first_point[i];
+			s->points[1][i] = s->points[2][i] - first_point[i];
+			s->points[2][i] = s->points[3][i] - first_point[i];
+			s->diffs[0][i] = s->diffs[1][i];
+			s->diffs[1][i] = s->diffs[2][i];
+			s->diffs[2][i] = s->diffs[3][i];
+		}
+	}
+	for(int i = 0; i < 2; ++i)
+	{
+		s->prev_seg[i] = s->curr_seg[i];
+		s->total_offset[i] += s->curr_seg[i];
+	}
+	return s->base[0] + s->total_offset[0] + (s->base[1] + s->total_offset[1]) * cpu->width;
+}
+
+static void arcPushSegment(ArcState* s, int const curr_seg[2])
+{
+	s->curr_seg[0] = curr_seg[0];
+	s->curr_seg[1] = curr_seg[1];
+	int const* prev_seg = s->prev_seg;
+	int const* total_offset = s->total_offset;
+
+	int dir_dot = prev_seg[0] * curr_seg[0] + prev_seg[1] * curr_seg[1];
+	if(dir_dot <= 0)
+	{
+		s->reset = 1;
+		return;
+	}
+
+	int dir_cross = cross2(prev_seg, curr_seg);
+	if(abs(dir_cross) > dir_dot)
+	{
+		s->reset = 1;
+		return;
+	}
+
+	int8_t dir = (dir_cross < 0) ? -1 : dir_cross > 0;
+	if((dir ^ s->dir_trend) == -2)
+	{
+		s->reset = 1;
+		return;
+	}
+	if(!s->dir_trend)
+		s->dir_trend = dir;
+
+	if(s->seg_cnt <= 3)
+	{
+		s->points[s->seg_cnt-1][0] = total_offset[0];
+		s->points[s->seg_cnt-1][1] = total_offset[1];
+		s->diffs[s->seg_cnt][0] = curr_seg[0];
+		s->diffs[s->seg_cnt][1] = curr_seg[1];
+
+		if(s->seg_cnt == 3)
+		{
+			s->points[3][0] = total_offset[0] + curr_seg[0];
+			s->points[3][1] = total_offset[1] + curr_seg[1];
+			s->diffs[0][0] = s->points[0][0] - s->points[3][0];
+			s->diffs[0][1] = s->points[0][1] - s->points[3][1];
+			s->cross_prods[0] = cross2(s->points[0], s->points[3]);
+			s->cross_prods[1] = cross2(s->points[1], s->points[0]);
+			s->cross_prods[2] = cross2(s->points[2], s->points[1]);
+			s->cross_prods[3] = cross2(s->points[3], s->points[2]);
+
+			if(!ellipseFromHist(s->diffs, s->cross_prods, s->foci))
+			{
+				s->reset = 2;
+				return;
+			}
+
+			s->edge_dist = getEllipseDist(s->foci);
+			if(!isNearEllipseEdge(s->foci, s->edge_dist, s->points[0][0] / 2.0f, s->points[0][1] / 2.0f))
+			{
+				s->reset = 2;
+				return;
+			}
+		}
+	}
+	else if(!isNearEllipseEdge(s->foci, s->edge_dist, total_offset[0], total_offset[1]))
+	{
+		uint8_t k = order[s->kick++];
+		s->kick &= 7;
+		uint8_t k_m1 = (k - 1) & 3;
+		uint8_t k_p1 = (k + 1) & 3;
+		float old_x = s->points[k][0], old_y = s->points[k][1];
+		for(int i = 0; i < 2; ++i)
+		{
+			s->points[k][i] = total_offset[i];
+			s->diffs[k][i] = s->points[k][i] - s->points[k_m1][i];
+			s->diffs[k_p1][i] = s->points[k_p1][i] - s->points[k][i];
+		}
+		s->cross_prods[k] = cross2(s->points[k], s->points[k_m1]);
+		s->cross_prods[k_p1] = cross2(s->points[k_p1], s->points[k]);
+
+		float new_foci[4];
+		if(!ellipseFromHist(s->diffs, s->cross_prods, new_foci))
+		{
+			s->reset = 1;
+			return;
+		}
+		float new_dist = getEllipseDist(new_foci);
+		if(!isNearEllipseEdge(new_foci, new_dist, old_x, old_y))
+		{
+			s->reset = 1;
+			return;
+		}
+		memcpy(s->foci, new_foci, sizeof(new_foci));
+		s->edge_dist = new_dist;
+	}
+	++s->seg_cnt;
+}
+
+static void buildArcs(CpuPipeline* cpu, uint16_t index)
+{
+	int x = cpu->start_coords[index * 2], y = cpu->start_coords[index * 2 + 1];
+	if(!x && !y)
+		return;
+
+	int remaining_segs = cpu->line_cnts[index];
+	int8_t const* line_data = cpu->line_data;
+	int pos = x + y * cpu->width;
+
+	ArcState s = {.base = {x, y}, .curr_seg = {line_data[pos * 2], line_data[pos * 2 + 1]}, .seg_cnt = 1};
+	while(--remaining_segs > 0)
+	{
+		pos = arcAdvance(cpu, &s);
+		int seg[2] = {line_data[pos * 2], line_data[pos * 2 + 1]};
+		arcPushSegment(&s, seg);
+	}
+
+	arcWrite(cpu, &s);
+}
+
+static void arcBuilderBand(void* ctx, int start, int end)
+{
+	CpuPipeline* cpu = ((CpuRun const*)ctx)->cpu;
+	for(int i = start; i < end; ++i)
+		buildArcs(cpu, i);
+}
+
+//---------------------------------------------------------------------------------------
+
+void allocCpuPipeline(CpuPipeline* cpu, int width, int height, clbp_Error* e)
+{
+	size_t px_cnt = (size_t)width * height;
+	*cpu = (CpuPipeline){.width = width, .height = height};
+	cpu->grad = malloc(px_cnt * 2);
+	cpu->grad_ang = malloc(px_cnt);
+	cpu->cont = malloc(px_cnt);
+	cpu->starts_cont = malloc(px_cnt);
+	cpu->start_coords = malloc(CPU_MAX_STARTS * 2 * sizeof(int16_t));
+	cpu->line_data = malloc(px_cnt * 2);
+	cpu->line_cnts = malloc(CPU_MAX_STARTS * sizeof(uint16_t));
+	cpu->seg_in_arc = malloc(px_cnt * sizeof(uint16_t));
+	cpu->ellipse_foci = malloc(px_cnt * 4 * sizeof(float));
+
+	if(!cpu->grad || !cpu->grad_ang || !cpu->cont || !cpu->starts_cont || !cpu->start_coords
+		|| !cpu->line_data || !cpu->line_cnts || !cpu->seg_in_arc || !cpu->ellipse_foci)
+	{
+		freeCpuPipeline(cpu);
+		e->err_code = CLBP_OUT_OF_MEMORY;
+		e->detail = "CPU pipeline buffers";
+	}
+}
+
+void runCpuPipeline(CpuPipeline* cpu, ThreadPool* pool, uint8_t const* input)
+{
+	struct timespec start;
+	uint16_t band_starts[cpu->height];
+	CpuRun run = {cpu, input, band_starts};
+
+	// sparse outputs only get written where there's data, same as the images with is_cleared set
+	memset(cpu->start_coords, 0, CPU_MAX_STARTS * 2 * sizeof(int16_t));
+	memset(cpu->line_data, 0, (size_t)cpu->width * cpu->height * 2);
+	memset(cpu->line_cnts, 0, CPU_MAX_STARTS * sizeof(uint16_t));
+	memset(cpu->seg_in_arc, 0, (size_t)cpu->width * cpu->height * sizeof(uint16_t));
+	memset(cpu->ellipse_foci, 0, (size_t)cpu->width * cpu->height * 4 * sizeof(float));
+
+	BandFunc dense_stages[] = {scharrBand, nonMaxSupBand, linkBand, findStartsBand};
+	for(int i = 0; i < CPU_SERIAL_REDUCE; ++i)
+	{
+		timespec_get(&start, TIME_UTC);
+		runBands(pool, cpu->height, dense_stages[i], &run);
+		cpu->stage_ms[i] = msSince(&start);
+	}
+
+	timespec_get(&start, TIME_UTC);
+	serialReduce(&run, pool);
+	cpu->stage_ms[CPU_SERIAL_REDUCE] = msSince(&start);
+
+	timespec_get(&start, TIME_UTC);
+	runBands(pool, cpu->start_cnt, lineSegmentsBand, &run);
+	cpu->stage_ms[CPU_LINE_SEGMENTS] = msSince(&start);
+
+	timespec_get(&start, TIME_UTC);
+	runBands(pool, cpu->start_cnt, arcBuilderBand, &run);
+	cpu->stage_ms[CPU_ARC_BUILDER] = msSince(&start);
+}
+
+void freeCpuPipeline(CpuPipeline* cpu)
+{
+	free(cpu->grad);
+	free(cpu->grad_ang);
+	free(cpu->cont);
+	free(cpu->starts_cont);
+	free(cpu->start_coords);
+	free(cpu->line_data);
+	free(cpu->line_cnts);
+	free(cpu->seg_in_arc);
+	free(cpu->ellipse_foci);
+	*cpu = (CpuPipeline){0};
+}
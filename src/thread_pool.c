@@ -0,0 +1,184 @@
+#include "thread_pool.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+uint16_t getHostThreadCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	long cnt = info.dwNumberOfProcessors;
+#else
+	long cnt = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(cnt < 1)
+		return 1;
+	return cnt > UINT16_MAX ? UINT16_MAX : cnt;
+}
+
+static void* workerMain(void* arg)
+{
+	ThreadPool* pool = arg;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;)
+	{
+		while(!pool->job_cnt && !pool->is_shutdown)
+			pthread_cond_wait(&pool->job_ready, &pool->lock);
+		// only exit once the queue has drained so nothing submitted gets dropped
+		if(!pool->job_cnt)
+			break;
+
+		ThreadPoolJob job = pool->jobs[pool->job_head];
+		pool->job_head = (pool->job_head + 1) % pool->job_cap;
+		--pool->job_cnt;
+		++pool->active_cnt;
+		// a queue slot just freed up, wake any blocked submitters
+		pthread_cond_broadcast(&pool->job_done);
+		pthread_mutex_unlock(&pool->lock);
+
+		job.func(job.arg);
+
+		pthread_mutex_lock(&pool->lock);
+		--pool->active_cnt;
+		if(!pool->active_cnt && !pool->job_cnt)
+			pthread_cond_broadcast(&pool->job_done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+int createThreadPool(ThreadPool* pool, uint16_t thread_cnt, uint32_t job_cap)
+{
+	if(!thread_cnt)
+		thread_cnt = getHostThreadCount();
+	if(!job_cap)
+		job_cap = 1;
+
+	*pool = (ThreadPool){.job_cap = job_cap};
+	pool->threads = malloc(thread_cnt * sizeof(pthread_t));
+	pool->jobs = malloc(job_cap * sizeof(ThreadPoolJob));
+	if(!pool->threads || !pool->jobs)
+	{
+		free(pool->threads);
+		free(pool->jobs);
+		return -1;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->job_ready, NULL);
+	pthread_cond_init(&pool->job_done, NULL);
+
+	for(; pool->thread_cnt < thread_cnt; ++pool->thread_cnt)
+	{
+		if(pthread_create(&pool->threads[pool->thread_cnt], NULL, workerMain, pool))
+		{
+			// couldn't start all the requested workers, only fail if none started
+			if(!pool->thread_cnt)
+			{
+				destroyThreadPool(pool);
+				return -1;
+			}
+			break;
+		}
+	}
+
+	return 0;
+}
+
+void submitJob(ThreadPool* pool, JobFunc func, void* arg)
+{
+	pthread_mutex_lock(&pool->lock);
+	while(pool->job_cnt == pool->job_cap)
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+
+	pool->jobs[(pool->job_head + pool->job_cnt) % pool->job_cap] = (ThreadPoolJob){func, arg};
+	++pool->job_cnt;
+	pthread_cond_signal(&pool->job_ready);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void waitForJobs(ThreadPool* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while(pool->job_cnt || pool->active_cnt)
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void destroyThreadPool(ThreadPool* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->is_shutdown = 1;
+	pthread_cond_broadcast(&pool->job_ready);
+	pthread_mutex_unlock(&pool->lock);
+
+	for(uint16_t i = 0; i < pool->thread_cnt; ++i)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->job_ready);
+	pthread_cond_destroy(&pool->job_done);
+	free(pool->threads);
+	free(pool->jobs);
+	*pool = (ThreadPool){0};
+}
+
+typedef struct {
+	ThreadPool* pool;
+	BandFunc func;
+	void* ctx;
+	int remaining;	// bands not yet completed, guarded by the pool lock
+} BandSet;
+
+typedef struct {
+	BandSet* set;
+	int y_start;
+	int y_end;
+} BandJob;
+
+static void runBandJob(void* arg)
+{
+	BandJob* band = arg;
+	BandSet* set = band->set;
+	set->func(set->ctx, band->y_start, band->y_end);
+
+	pthread_mutex_lock(&set->pool->lock);
+	if(!--set->remaining)
+		pthread_cond_broadcast(&set->pool->job_done);
+	pthread_mutex_unlock(&set->pool->lock);
+}
+
+// only waits on its own bands so it can share the pool with unrelated long running jobs
+void runBands(ThreadPool* pool, int height, BandFunc func, void* ctx)
+{
+	// a few bands per thread evens out bands that happen to be heavier than the rest
+	int band_cnt = pool->thread_cnt * 4;
+	if(band_cnt > height)
+		band_cnt = height;
+	BandJob* bands = band_cnt > 1 ? malloc(band_cnt * sizeof(BandJob)) : NULL;
+	if(!bands)	// nothing to split or couldn't allocate, run single threaded rather than fail
+	{
+		func(ctx, 0, height);
+		return;
+	}
+
+	BandSet set = {pool, func, ctx, band_cnt};
+	for(int i = 0; i < band_cnt; ++i)
+	{
+		bands[i] = (BandJob){&set, (int)((int64_t)height * i / band_cnt), (int)((int64_t)height * (i + 1) / band_cnt)};
+		submitJob(pool, runBandJob, &bands[i]);
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	while(set.remaining)
+		pthread_cond_wait(&pool->job_done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+	free(bands);
+}